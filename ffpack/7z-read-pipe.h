@@ -0,0 +1,341 @@
+/** ffpack: .7z pipelined filter chain executor
+Each decoder filter runs in its own thread;
+ the stages are connected by single-producer/single-consumer rings of data chunks:
+ (user) -> input -> ring -> [thread: coder] -> ring -> ... -> bounds -> CRC -> (user)
+Input, bounds and CRC filters run in the user's thread,
+ so user I/O overlaps with decoding.
+2020, Simon Zolin */
+
+#include <pthread.h>
+
+#define _FF7ZR_PIPE_CHUNKS  4
+
+/** Ring of data chunks between 2 stages */
+struct _ff7zr_ring {
+	ffvec chunk[_FF7ZR_PIPE_CHUNKS];
+	ffuint r, w; // read/write counters
+	ffuint fin; // the producer has finished
+};
+
+struct _ff7zr_stage {
+	pthread_t th;
+	struct _ff7zr_pipe *p;
+	struct z7_filter *f;
+	struct _ff7zr_ring *in, *out;
+};
+
+struct _ff7zr_pipe {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	ffuint stop;
+	int err;
+	ffuint nstages, nthreads;
+	struct _ff7zr_stage stage[Z7_MAX_CODERS];
+	struct _ff7zr_ring ring[Z7_MAX_CODERS + 1];
+	ffuint input_done :1;
+	ffuint held :1; // the bounds filter uses the chunk from the last ring
+};
+
+/** Get the next chunk from ring
+Return 0: chunk is ready;  1: no more data;  -1: stopped */
+static int _ff7zr_ring_get(struct _ff7zr_pipe *p, struct _ff7zr_ring *ring, ffstr *data)
+{
+	int r;
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		if (p->stop) {
+			r = -1;
+			break;
+		} else if (ring->r != ring->w) {
+			ffstr_set2(data, &ring->chunk[ring->r % _FF7ZR_PIPE_CHUNKS]);
+			r = 0;
+			break;
+		} else if (ring->fin) {
+			r = 1;
+			break;
+		}
+		pthread_cond_wait(&p->cond, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return r;
+}
+
+/** Return the chunk taken with _ff7zr_ring_get() */
+static void _ff7zr_ring_release(struct _ff7zr_pipe *p, struct _ff7zr_ring *ring)
+{
+	pthread_mutex_lock(&p->lock);
+	ring->r++;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/** Copy data to the next free chunk, wait if the ring is full
+Return 0 on success;  -1: stopped;  Z7_ESYS */
+static int _ff7zr_ring_put(struct _ff7zr_pipe *p, struct _ff7zr_ring *ring, const void *data, ffsize len)
+{
+	pthread_mutex_lock(&p->lock);
+	while (!p->stop && ring->w - ring->r == _FF7ZR_PIPE_CHUNKS) {
+		pthread_cond_wait(&p->cond, &p->lock);
+	}
+	ffuint stop = p->stop;
+	pthread_mutex_unlock(&p->lock);
+	if (stop)
+		return -1;
+
+	// the chunk isn't visible to the consumer until 'w' is incremented
+	ffvec *c = &ring->chunk[ring->w % _FF7ZR_PIPE_CHUNKS];
+	c->len = 0;
+	if (len != ffvec_addT(c, data, len, char))
+		return Z7_ESYS;
+
+	pthread_mutex_lock(&p->lock);
+	ring->w++;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	return 0;
+}
+
+/** Mark the ring as finished; set the pipeline error */
+static void _ff7zr_ring_fin(struct _ff7zr_pipe *p, struct _ff7zr_ring *ring, int err)
+{
+	pthread_mutex_lock(&p->lock);
+	ring->fin = 1;
+	if (err != 0 && p->err == 0)
+		p->err = err;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/** Stage thread: pass the data from the input ring through a coder filter to the output ring */
+static void* _ff7zr_stage_run(void *param)
+{
+	struct _ff7zr_stage *st = (struct _ff7zr_stage*)param;
+	struct _ff7zr_pipe *p = st->p;
+	struct z7_filter *c = st->f;
+	int r, e = 0, held = 0;
+	ffsize inlen;
+
+	for (;;) {
+		if (c->in.len == 0 && !c->fin) {
+			if (held) {
+				_ff7zr_ring_release(p, st->in);
+				held = 0;
+			}
+			r = _ff7zr_ring_get(p, st->in, &c->in);
+			if (r < 0)
+				return NULL;
+			if (r == 1)
+				c->fin = 1;
+			else
+				held = 1;
+		}
+
+		inlen = c->in.len;
+		r = c->process(c);
+		c->read += inlen - c->in.len;
+
+		switch (r) {
+		case _FF7ZR_FILT_MORE:
+			if (c->fin) {
+				e = Z7_EDATA;
+				goto end;
+			}
+			c->in.len = 0;
+			continue;
+
+		case _FF7ZR_FILT_DATA:
+			c->written += c->buf.len;
+			if (0 != (r = _ff7zr_ring_put(p, st->out, c->buf.ptr, c->buf.len))) {
+				if (r < 0)
+					return NULL;
+				e = r;
+				goto end;
+			}
+			c->buf.len = 0;
+			continue;
+
+		case _FF7ZR_FILT_DONE:
+			goto end;
+
+		case _FF7ZR_FILT_ERR:
+			e = c->err;
+			goto end;
+
+		default:
+			e = Z7_EDATA;
+			goto end;
+		}
+	}
+
+end:
+	_ff7zr_ring_fin(p, st->out, e);
+	return NULL;
+}
+
+static void _ff7zread_pipe_stop(ff7zread *z)
+{
+	struct _ff7zr_pipe *p = z->pipe;
+	if (p == NULL)
+		return;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	for (ffuint i = 0;  i != p->nthreads;  i++) {
+		pthread_join(p->stage[i].th, NULL);
+	}
+
+	for (ffuint i = 0;  i != p->nstages + 1;  i++) {
+		for (ffuint k = 0;  k != _FF7ZR_PIPE_CHUNKS;  k++) {
+			ffvec_free(&p->ring[i].chunk[k]);
+		}
+	}
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	ffmem_free(p);
+	z->pipe = NULL;
+}
+
+/** Start a thread for each decoder filter of the current chain
+Chains with BCJ2 coder are processed serially.
+Return 0 if the chain runs serially or the threads are started */
+static int _ff7zread_pipe_start(ff7zread *z)
+{
+	ffuint n = z->_filters.len - 2;
+	if (n == 0 || z->filters[0].input.copy)
+		return 0;
+
+	struct _ff7zr_pipe *p = ffmem_new(struct _ff7zr_pipe);
+	if (p == NULL)
+		return Z7_ESYS;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	p->nstages = n;
+	z->pipe = p;
+
+	for (ffuint i = 0;  i != n;  i++) {
+		struct _ff7zr_stage *st = &p->stage[i];
+		st->p = p;
+		st->f = &z->filters[1 + i];
+		st->in = &p->ring[i];
+		st->out = &p->ring[i + 1];
+		if (0 != pthread_create(&st->th, NULL, _ff7zr_stage_run, st)) {
+			_ff7zread_pipe_stop(z);
+			return Z7_ESYS;
+		}
+		p->nthreads++;
+	}
+	_ff7zread_log(z, 0, "started %u pipeline threads", n);
+	return 0;
+}
+
+/** Get the next chunk from the last ring, feeding the first ring with input data meanwhile
+Return 0: chunk is ready;  1: no more data;  enum FF7ZREAD_R */
+static int _ff7zread_pipe_fetch(ff7zread *z, ffstr *data)
+{
+	struct _ff7zr_pipe *p = z->pipe;
+	struct _ff7zr_ring *first = &p->ring[0], *last = &p->ring[p->nstages];
+	struct z7_filter *c = &z->filters[0];
+	int r;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		if (last->r != last->w) {
+			ffstr_set2(data, &last->chunk[last->r % _FF7ZR_PIPE_CHUNKS]);
+			r = 0;
+			break;
+
+		} else if (last->fin) {
+			r = 1;
+			if (p->err != 0) {
+				z->err = p->err;
+				r = FF7ZREAD_ERROR;
+			}
+			break;
+
+		} else if (!p->input_done && first->w - first->r != _FF7ZR_PIPE_CHUNKS) {
+			pthread_mutex_unlock(&p->lock);
+
+			ffsize inlen = c->in.len;
+			r = c->process(c);
+			c->read += inlen - c->in.len;
+			switch (r) {
+			case _FF7ZR_FILT_DATA:
+				c->written += c->buf.len;
+				if (0 != (r = _ff7zr_ring_put(p, first, c->buf.ptr, c->buf.len)))
+					return _ERR(z, (r < 0) ? Z7_EDATA : r);
+				break;
+
+			case _FF7ZR_FILT_DONE:
+				p->input_done = 1;
+				_ff7zr_ring_fin(p, first, 0);
+				break;
+
+			case _FF7ZR_FILT_SEEK:
+				return FF7ZREAD_SEEK;
+
+			case _FF7ZR_FILT_MORE:
+				return FF7ZREAD_MORE;
+
+			default:
+				return _ERR(z, c->err);
+			}
+
+			pthread_mutex_lock(&p->lock);
+			continue;
+		}
+
+		pthread_cond_wait(&p->cond, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return r;
+}
+
+/** Pipelined version of _ff7zread_filters_call() */
+static int _ff7zread_pipe_call(ff7zread *z, ffstr *output)
+{
+	struct _ff7zr_pipe *p = z->pipe;
+	const ff7zread_fileinfo *f = &((ff7zread_fileinfo*)z->cur_folder->files.ptr)[z->cur_folder->ifile - 1];
+	struct z7_filter *c = &z->filters[z->_filters.len - 1];
+	int r;
+
+	ffsize inlen = c->in.len;
+	r = c->process(c);
+	c->read += inlen - c->in.len;
+
+	switch (r) {
+	case _FF7ZR_FILT_DATA:
+		ffstr_set2(output, &c->buf);
+		z->crc = crc32((void*)output->ptr, output->len, z->crc);
+		return FF7ZREAD_DATA;
+
+	case _FF7ZR_FILT_DONE:
+		if (f->crc != z->crc) {
+			_ff7zread_log(z, 0, "CRC mismatch: should be: %xu  computed: %xu", f->crc, z->crc);
+			return _ERR(z, Z7_EDATACRC);
+		}
+		return FF7ZREAD_FILEDONE;
+	}
+
+	// _FF7ZR_FILT_MORE
+	if (c->fin)
+		return _ERR(z, Z7_EDATA);
+
+	if (p->held) {
+		_ff7zr_ring_release(p, &p->ring[p->nstages]);
+		p->held = 0;
+	}
+
+	if (0 != (r = _ff7zread_pipe_fetch(z, &c->in))) {
+		if (r != 1)
+			return r;
+		c->fin = 1;
+		return 0;
+	}
+	p->held = 1;
+	if (z->cache_limit != 0)
+		_ff7zread_cache_add(z, c->read, c->in);
+	return 0;
+}
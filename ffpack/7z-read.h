@@ -1,4 +1,8 @@
 /** ffpack: .7z reader
+
+Building:
+Define FFPACK_7ZREAD_THREADS to enable pipelined decoding (ff7zread.pipeline) with pthreads.
+
 2017,2021, Simon Zolin
 */
 
@@ -8,7 +12,16 @@ ff7zread_open
 ff7zread_close
 ff7zread_process
 ff7zread_nextfile
+ff7zread_fileopen
+ff7zread_select
+ff7zread_find
 ff7zread_offset
+ff7zread_folders
+ff7zread_folders_order
+ff7zread_open_folder
+ff7zread_folder_lzma2
+ff7zread_lzma2_split
+ff7zread_lzma2_decode
 */
 
 #pragma once
@@ -16,11 +29,14 @@ ff7zread_offset
 #include <ffpack/base/7z.h>
 #include <zlib/zlib-ff.h>
 #include <lzma/lzma-ff.h>
+#include <zstd/zstd-ff.h>
 #include <ffbase/time.h>
+#include <ffbase/sort.h>
 
 struct z7_folder;
 struct z7_filter;
 struct z7_block;
+struct _ff7zr_bcj2;
 
 typedef void (*ff7zread_log)(void *udata, ffuint level, ffstr msg);
 
@@ -29,6 +45,7 @@ typedef struct ff7zread {
 	int err;
 	ffuint64 off;
 	ffuint hdr_packed :1;
+	ffuint folder_clone :1; // file list is owned by another reader
 	ffstr *input;
 	ffvec buf;
 
@@ -48,6 +65,25 @@ typedef struct ff7zread {
 	ffuint ifilter;
 	ffuint crc;
 
+	ffvec cache; // struct _ff7zr_span[]
+	ffsize cache_size; // total size of cached data
+	ffuint64 cache_tick;
+	ffvec cache_cur; // the span being filled
+	ffuint64 cache_cur_off; // folder offset of 'cache_cur'
+	ffuint64 cache_off, cache_end; // the file area being read from cache
+
+	/* Max. memory for caching decoded data of solid folders (0: disabled).
+	Files (or their parts) read again with ff7zread_fileopen() are taken from cache
+	 instead of decoding the folder from the beginning. */
+	ffsize cache_limit;
+
+#ifdef FFPACK_7ZREAD_THREADS
+	struct _ff7zr_pipe *pipe;
+
+	/* Decode folder data in a pipeline: each coder runs in its own thread */
+	ffuint pipeline :1;
+#endif
+
 	ff7zread_log log;
 	void *udata;
 } ff7zread;
@@ -76,9 +112,12 @@ struct z7_filter {
 			ffuint64 off;
 			ffuint64 size;
 			ff7zread *z;
+			ffuint copy; // copy input data (it must stay valid after seeking to another stream)
 		} input;
 		lzma_decoder *lzma;
+		struct _ff7zr_bcj2 *bcj2;
 		z_ctx *zlib;
+		zstd_decoder *zstd;
 		struct {
 			ffuint64 off;
 			ffuint64 size;
@@ -111,6 +150,7 @@ static inline const char* ff7zread_error(ff7zread *z)
 		"data checksum mismatch", // Z7_EDATACRC
 		"liblzma error", // Z7_ELZMA
 		"libz error", // Z7_EZLIB
+		"libzstd error", // Z7_EZSTD
 	};
 	ffuint e = z->err;
 	if (e >= FF_COUNT(errs))
@@ -123,7 +163,7 @@ static inline const char* ff7zread_error(ff7zread *z)
 
 enum {
 	R_START, R_GATHER, R_GHDR, R_BLKID, R_META_UNPACK,
-	R_FSTART, R_FDATA, R_FDONE, R_FNEXT,
+	R_FSTART, R_FDATA, R_FDONE, R_FNEXT, R_FCACHE,
 };
 
 #define ff7zread_offset(z)  ((z)->off)
@@ -151,6 +191,7 @@ static inline void _ff7zread_log(ff7zread *z, ffuint level, const char *fmt, ...
 }
 
 static int _ff7zr_deflate_init(struct z7_filter *c, ffuint method);
+static int _ff7zr_zstd_init(struct z7_filter *c);
 static int _ff7zr_lzma_init(struct z7_filter *c, ffuint method, const void *props, ffuint nprops);
 static int _ff7zr_bounds_process(struct z7_filter *c);
 
@@ -164,6 +205,11 @@ static int z7_filter_init(struct z7_filter *c, const struct z7_coder *coder)
 			return r;
 		break;
 
+	case Z7_M_ZSTD:
+		if (0 != (r = _ff7zr_zstd_init(c)))
+			return r;
+		break;
+
 	case Z7_M_X86:
 	case Z7_M_LZMA1:
 	case Z7_M_LZMA2:
@@ -185,6 +231,7 @@ enum {
 	_FF7ZR_FILT_SEEK,
 	_FF7ZR_FILT_ERR,
 	_FF7ZR_FILT_DONE,
+	_FF7ZR_FILT_INPUT, // need more input data from user
 };
 
 /** Take input data from user and pass to the next filter
@@ -204,7 +251,18 @@ static int z7_input_process(struct z7_filter *c)
 		return _FF7ZR_FILT_MORE;
 
 	ffsize n = ffmin(c->input.size, z->input->len);
-	ffstr_set(&c->buf, z->input->ptr, n);
+	if (c->input.copy) {
+		if (c->buf.cap == 0
+			&& NULL == ffvec_alloc(&c->buf, 64 * 1024, 1)) {
+			c->err = Z7_ESYS;
+			return _FF7ZR_FILT_ERR;
+		}
+		n = ffmin(n, c->buf.cap);
+		ffmem_copy(c->buf.ptr, z->input->ptr, n);
+		c->buf.len = n;
+	} else {
+		ffstr_set(&c->buf, z->input->ptr, n);
+	}
 	ffstr_shift(z->input, n);
 	z->off += n;
 	c->input.off += n;
@@ -212,45 +270,66 @@ static int z7_input_process(struct z7_filter *c)
 	return _FF7ZR_FILT_DATA;
 }
 
+static int _ff7zr_bcj2_init(ff7zread *z, struct z7_filter *c, const struct z7_folder *fo, const struct z7_coder *cod);
+
+static void _ff7zr_input_init(ff7zread *z, struct z7_filter *c, const struct z7_stream *stm, ffuint copy)
+{
+	c->input.off = stm->off;
+	c->input.size = stm->pack_size;
+	c->input.z = z;
+	c->input.copy = copy;
+	c->process = z7_input_process;
+}
+
+/** Create the filter chain from the coder graph:
+input -> coder -> ... -> coder -> bounds
+The chain is built from the last coder (its output is folder's output)
+ by following the coders bound to input #0.
+Only BCJ2 coder may have more inputs: they are decoded by separate sub-chains inside BCJ2 filter,
+ and all input filters copy data, because the streams are read in turn at different offsets. */
 static int _ff7zread_filters_create(ff7zread *z, struct z7_folder *fo)
 {
 	int r;
-	ffuint i, k = 0;
+	ffuint chain[Z7_MAX_CODERS], n = 0, k = 0, copy = 0;
+
+	if (fo->coders == 0)
+		return Z7_EDATA;
+	ffuint i = fo->coders - 1;
+	for (;;) {
+		if (n == Z7_MAX_CODERS)
+			return Z7_EDATA; // loop
+		if (fo->coder[i].method == Z7_M_X86_BCJ2)
+			copy = 1;
+		else if (fo->coder[i].inputs != 1)
+			return Z7_EUNSUPP;
+		chain[n++] = i;
+		ffuint ic = fo->coder[i].input_coders[0];
+		if (ic == 0)
+			break;
+		i = ic - 1;
+	}
+
+	const struct z7_coder *first = &fo->coder[chain[n - 1]];
+	if (first->stream.off == 0 && first->stream.pack_size == 0)
+		return Z7_EUNSUPP; // the first coder must have an assigned input stream
 
 	if (NULL == ffslice_zallocT(&z->_filters, 1 + Z7_MAX_CODERS + 1, struct z7_filter))
 		return Z7_ESYS;
 	z->filters = (struct z7_filter*)z->_filters.ptr;
+	z->_filters.len = 1 + n + 1; // for _ff7zread_filters_close() on error
 
-	for (i = 0;  i != fo->coders;  i++) {
-		struct z7_coder *cod = &fo->coder[i];
-		struct z7_filter *fi;
-		if (cod->stream.off != 0 || cod->stream.pack_size != 0) {
-			if (k != 0)
-				return Z7_EUNSUPP;
-			fi = &z->filters[k++];
-			if (cod->input_coders[0] != 0)
-				return Z7_EUNSUPP;
-			fi->input.off = cod->stream.off;
-			fi->input.size = cod->stream.pack_size;
-			fi->input.z = z;
-			fi->process = z7_input_process;
-
-		} else if (cod->input_coders[0] == 0
-			|| (int)cod->input_coders[0] - 1 != (int)i - 1
-			|| cod->input_coders[1] != 0) {
-
-			/* Currently only a simple coder chain is supported:
-			input -> unpack -> x86 -> bounds
-			unpack must have an assigned input stream
-			x86's input must be unpack's output
-			*/
-			return Z7_EUNSUPP;
-		}
+	_ff7zr_input_init(z, &z->filters[k++], &first->stream, copy);
 
+	while (n != 0) {
+		const struct z7_coder *cod = &fo->coder[chain[--n]];
 		if (cod->method == Z7_M_STORE)
 			continue;
-		fi = &z->filters[k++];
-		if (0 != (r = z7_filter_init(fi, cod)))
+		struct z7_filter *fi = &z->filters[k++];
+		if (cod->method == Z7_M_X86_BCJ2)
+			r = _ff7zr_bcj2_init(z, fi, fo, cod);
+		else
+			r = z7_filter_init(fi, cod);
+		if (r != 0)
 			return r;
 	}
 
@@ -261,9 +340,18 @@ static int _ff7zread_filters_create(ff7zread *z, struct z7_folder *fo)
 	return 0;
 }
 
+#ifdef FFPACK_7ZREAD_THREADS
+static void _ff7zread_pipe_stop(ff7zread *z);
+static int _ff7zread_pipe_start(ff7zread *z);
+static int _ff7zread_pipe_call(ff7zread *z, ffstr *output);
+#endif
+
 static void _ff7zread_filters_close(ff7zread *z)
 {
 	struct z7_filter *f;
+#ifdef FFPACK_7ZREAD_THREADS
+	_ff7zread_pipe_stop(z);
+#endif
 	FFSLICE_WALK(&z->_filters, f) {
 		if (f->init)
 			f->destroy(f);
@@ -273,16 +361,151 @@ static void _ff7zread_filters_close(ff7zread *z)
 	z->filters = NULL;
 }
 
+/** Decoded data of a folder: [off..off+data.len) */
+struct _ff7zr_span {
+	ffuint folder;
+	ffuint64 off;
+	ffvec data;
+	ffuint64 used; // LRU tick
+};
+
+#define _FF7ZR_SPAN  (256*1024)
+
+static void _ff7zread_cache_free(ff7zread *z)
+{
+	struct _ff7zr_span *sp;
+	FFSLICE_WALK(&z->cache, sp) {
+		ffvec_free(&sp->data);
+	}
+	ffvec_free(&z->cache);
+	ffvec_free(&z->cache_cur);
+	z->cache_size = 0;
+}
+
+static struct _ff7zr_span* _ff7zread_cache_find(ff7zread *z, ffuint folder, ffuint64 off)
+{
+	struct _ff7zr_span *sp;
+	FFSLICE_WALK(&z->cache, sp) {
+		if (sp->folder == folder && sp->off == off)
+			return sp;
+	}
+	return NULL;
+}
+
+/** Move the filled span to cache; remove the least recently used spans */
+static void _ff7zread_cache_put(ff7zread *z, ffuint folder)
+{
+	if (z->cache_cur.len == 0)
+		return;
+
+	if (NULL != _ff7zread_cache_find(z, folder, z->cache_cur_off)
+		|| z->cache_cur.len > z->cache_limit) {
+		z->cache_cur.len = 0;
+		return;
+	}
+
+	while (z->cache_size + z->cache_cur.len > z->cache_limit) {
+		struct _ff7zr_span *sp, *lru = (struct _ff7zr_span*)z->cache.ptr;
+		FFSLICE_WALK(&z->cache, sp) {
+			if (sp->used < lru->used)
+				lru = sp;
+		}
+		z->cache_size -= lru->data.len;
+		ffvec_free(&lru->data);
+		*lru = *ffslice_lastT(&z->cache, struct _ff7zr_span);
+		z->cache.len--;
+	}
+
+	struct _ff7zr_span *sp = ffvec_pushT(&z->cache, struct _ff7zr_span);
+	if (sp == NULL) {
+		z->cache_cur.len = 0;
+		return;
+	}
+	sp->folder = folder;
+	sp->off = z->cache_cur_off;
+	sp->used = z->cache_tick++;
+	sp->data = z->cache_cur;
+	ffvec_null(&z->cache_cur);
+	z->cache_size += sp->data.len;
+}
+
+/** Store the decoded folder data (input for the bounds filter)
+off: folder offset of 'data' */
+static void _ff7zread_cache_add(ff7zread *z, ffuint64 off, ffstr data)
+{
+	ffuint folder = z->cur_folder - (struct z7_folder*)z->folders.ptr;
+	ffuint64 end = z->cur_folder->unpack_size;
+
+	while (data.len != 0) {
+		if (z->cache_cur.len == 0) {
+			ffuint64 skip = ffint_align_ceil2(off, _FF7ZR_SPAN) - off;
+			if (skip >= data.len)
+				break; // a span may start only at its boundary
+			off += skip;
+			ffstr_shift(&data, skip);
+			z->cache_cur_off = off;
+
+		} else if (z->cache_cur_off + z->cache_cur.len != off) {
+			z->cache_cur.len = 0; // a gap in data
+			continue;
+		}
+
+		ffsize n = ffmin(data.len, _FF7ZR_SPAN - z->cache_cur.len);
+		if (n != ffvec_addT(&z->cache_cur, data.ptr, n, char)) {
+			z->cache_cur.len = 0;
+			return;
+		}
+		off += n;
+		ffstr_shift(&data, n);
+
+		if (z->cache_cur.len == _FF7ZR_SPAN || off == end)
+			_ff7zread_cache_put(z, folder);
+	}
+}
+
+/** Prepare to read the file from cache
+Return 0 if the whole file data is in cache */
+static int _ff7zread_cache_fileopen(ff7zread *z, const ff7zread_fileinfo *f)
+{
+	if (z->cache_limit == 0 || f->size == 0)
+		return -1;
+
+	ffuint folder = z->cur_folder - (struct z7_folder*)z->folders.ptr;
+	ffuint64 off = ffint_align_floor2(f->off, _FF7ZR_SPAN);
+	for (;  off < f->off + f->size;  off += _FF7ZR_SPAN) {
+		if (NULL == _ff7zread_cache_find(z, folder, off))
+			return -1;
+	}
+
+	z->cache_off = f->off;
+	z->cache_end = f->off + f->size;
+	return 0;
+}
+
+/** Get the next portion of file data from cache */
+static int _ff7zread_cache_read(ff7zread *z, ffstr *output)
+{
+	ffuint folder = z->cur_folder - (struct z7_folder*)z->folders.ptr;
+	struct _ff7zr_span *sp = _ff7zread_cache_find(z, folder, ffint_align_floor2(z->cache_off, _FF7ZR_SPAN));
+	if (sp == NULL)
+		return -1;
+	sp->used = z->cache_tick++;
+
+	ffsize i = z->cache_off - sp->off;
+	ffsize n = ffmin(sp->data.len - i, z->cache_end - z->cache_off);
+	ffstr_set(output, (char*)sp->data.ptr + i, n);
+	z->cache_off += n;
+	return 0;
+}
+
 static void z7_folders_free(ffvec *folders)
 {
 	struct z7_folder *fo;
 	FFSLICE_WALK(folders, fo) {
-		ff7zread_fileinfo *f;
-		FFSLICE_WALK(&fo->files, f) {
-			ffstr_free(&f->name);
-		}
 		ffvec_free(&fo->files);
 		ffvec_free(&fo->empty);
+		ffvec_free(&fo->file_arena);
+		ffvec_free(&fo->name_arena);
 	}
 	ffvec_free(folders);
 }
@@ -292,7 +515,11 @@ static inline void ff7zread_close(ff7zread *z)
 	ffvec_free(&z->buf);
 	ffvec_free(&z->gbuf);
 	_ff7zread_filters_close(z);
-	z7_folders_free(&z->folders);
+	_ff7zread_cache_free(z);
+	if (z->folder_clone)
+		ffvec_free(&z->folders);
+	else
+		z7_folders_free(&z->folders);
 	ffmem_free(z->blks);  z->blks = NULL;
 }
 
@@ -344,6 +571,54 @@ static int _ff7zr_deflate_process(struct z7_filter *c)
 }
 
 
+static int _ff7zr_zstd_process(struct z7_filter *c);
+static void _ff7zr_zstd_destroy(struct z7_filter *c);
+
+/** zstd data may consist of several frames (e.g. written by multiple threads) */
+static int _ff7zr_zstd_init(struct z7_filter *c)
+{
+	zstd_dec_conf conf = {};
+	c->zstd = NULL;
+	if (0 != zstd_decode_init(&c->zstd, &conf))
+		return Z7_EZSTD;
+
+	if (NULL == ffvec_alloc(&c->buf, 64 * 1024, 1)) {
+		zstd_decode_free(c->zstd);
+		return Z7_ESYS;
+	}
+
+	c->process = _ff7zr_zstd_process;
+	c->destroy = _ff7zr_zstd_destroy;
+	return 0;
+}
+
+static void _ff7zr_zstd_destroy(struct z7_filter *c)
+{
+	zstd_decode_free(c->zstd);  c->zstd = NULL;
+}
+
+static int _ff7zr_zstd_process(struct z7_filter *c)
+{
+	zstd_buf in, out;
+	zstd_buf_set(&in, (void*)c->in.ptr, c->in.len);
+	zstd_buf_set(&out, ffslice_end(&c->buf, 1), ffvec_unused(&c->buf));
+	int r = zstd_decode(c->zstd, &in, &out);
+	if (r < 0) {
+		c->err = Z7_EZSTD;
+		return _FF7ZR_FILT_ERR;
+	}
+
+	ffstr_shift(&c->in, in.pos);
+	if (out.pos == 0) {
+		if (c->fin && c->in.len == 0)
+			return _FF7ZR_FILT_DONE;
+		return _FF7ZR_FILT_MORE;
+	}
+
+	c->buf.len += out.pos;
+	return _FF7ZR_FILT_DATA;
+}
+
 static int _ff7zr_lzma_process(struct z7_filter *c);
 static void _ff7zr_lzma_destroy(struct z7_filter *c);
 
@@ -408,6 +683,277 @@ static int _ff7zr_lzma_process(struct z7_filter *c)
 }
 
 
+/** Sub-chain for a BCJ2 input stream: input -> [decoder] */
+struct _ff7zr_bcj2_sub {
+	struct z7_filter f[2];
+	ffuint n, i;
+	ffstr data; // output data
+};
+
+struct _ff7zr_bcj2 {
+	struct _ff7zr_bcj2_sub sub[3]; // call, jump, range coder
+	ffuint state;
+	ffuint range, code;
+	ffuint n; // bytes read in the current state
+	ffuint src;
+	ffuint op, prev, bit;
+	ffuint64 out_pos, out_size;
+	ffushort probs[256 + 2]; // E8 (by previous byte), E9, Jcc
+};
+
+enum {
+	_FF7ZR_BCJ2_INIT, _FF7ZR_BCJ2_COPY, _FF7ZR_BCJ2_BIT, _FF7ZR_BCJ2_NORM, _FF7ZR_BCJ2_ADDR,
+};
+
+static int _ff7zr_bcj2_process(struct z7_filter *c);
+static void _ff7zr_bcj2_destroy(struct z7_filter *c);
+
+/** BCJ2 inputs: #0: main data (the filter's input);  #1: CALL addresses;  #2: JUMP addresses;  #3: range coder.
+Each of #1..#3 is a packed stream or a single-input coder with a packed stream. */
+static int _ff7zr_bcj2_init(ff7zread *z, struct z7_filter *c, const struct z7_folder *fo, const struct z7_coder *cod)
+{
+	int r;
+	if (cod->inputs != 4)
+		return Z7_EUNSUPP;
+
+	struct _ff7zr_bcj2 *b;
+	if (NULL == (b = ffmem_new(struct _ff7zr_bcj2)))
+		return Z7_ESYS;
+	c->bcj2 = b;
+	c->process = _ff7zr_bcj2_process;
+	c->destroy = _ff7zr_bcj2_destroy;
+	c->init = 1;
+
+	b->range = 0xffffffff;
+	b->out_size = cod->unpack_size;
+	for (ffuint i = 0;  i != FF_COUNT(b->probs);  i++) {
+		b->probs[i] = 2048 >> 1;
+	}
+
+	for (ffuint i = 0;  i != 3;  i++) {
+		struct _ff7zr_bcj2_sub *sub = &b->sub[i];
+		ffuint ic = cod->input_coders[i + 1];
+		if (ic == 0) {
+			_ff7zr_input_init(z, &sub->f[0], &cod->streams[i], 1);
+			sub->n = 1;
+			continue;
+		}
+
+		const struct z7_coder *sc = &fo->coder[ic - 1];
+		if (sc->inputs != 1 || sc->input_coders[0] != 0)
+			return Z7_EUNSUPP;
+		_ff7zr_input_init(z, &sub->f[0], &sc->stream, 1);
+		sub->n = 1;
+		if (sc->method != Z7_M_STORE) {
+			if (0 != (r = z7_filter_init(&sub->f[1], sc)))
+				return r;
+			sub->n = 2;
+		}
+	}
+
+	if (NULL == ffvec_alloc(&c->buf, 64 * 1024, 1))
+		return Z7_ESYS;
+	return 0;
+}
+
+static void _ff7zr_bcj2_destroy(struct z7_filter *c)
+{
+	struct _ff7zr_bcj2 *b = c->bcj2;
+	for (ffuint i = 0;  i != 3;  i++) {
+		for (ffuint k = 0;  k != 2;  k++) {
+			struct z7_filter *f = &b->sub[i].f[k];
+			if (f->init)
+				f->destroy(f);
+			ffvec_free(&f->buf);
+		}
+	}
+	ffmem_free(b);  c->bcj2 = NULL;
+}
+
+/** Get the next portion of data from a sub-chain */
+static int _ff7zr_bcj2_sub_read(struct _ff7zr_bcj2_sub *s, int *err)
+{
+	for (;;) {
+		struct z7_filter *c = &s->f[s->i];
+		ffsize inlen = c->in.len;
+		int r = c->process(c);
+		c->read += inlen - c->in.len;
+
+		switch (r) {
+		case _FF7ZR_FILT_MORE:
+			if (c->fin) {
+				*err = Z7_EDATA;
+				return _FF7ZR_FILT_ERR;
+			}
+			if (s->i == 0)
+				return _FF7ZR_FILT_INPUT;
+			s->i--;
+			break;
+
+		case _FF7ZR_FILT_DATA:
+			if (s->i + 1 == s->n) {
+				ffstr_set2(&s->data, &c->buf);
+				c->buf.len = 0;
+				return _FF7ZR_FILT_DATA;
+			}
+			ffstr_set2(&s->f[s->i + 1].in, &c->buf);
+			c->buf.len = 0;
+			s->i++;
+			break;
+
+		case _FF7ZR_FILT_DONE:
+			if (s->i + 1 == s->n)
+				return _FF7ZR_FILT_DONE;
+			s->f[s->i + 1].fin = 1;
+			s->i++;
+			break;
+
+		case _FF7ZR_FILT_ERR:
+			*err = c->err;
+			return r;
+
+		default:
+			return r; // seek
+		}
+	}
+}
+
+/** Get the next byte from input #1..#3
+Return _FF7ZR_FILT_DATA on success */
+static int _ff7zr_bcj2_byte(struct z7_filter *c, ffuint i, ffuint *byte)
+{
+	struct _ff7zr_bcj2_sub *s = &c->bcj2->sub[i];
+	while (s->data.len == 0) {
+		int r = _ff7zr_bcj2_sub_read(s, &c->err);
+		if (r == _FF7ZR_FILT_DONE) {
+			c->err = Z7_EDATA; // not enough data
+			return _FF7ZR_FILT_ERR;
+		} else if (r != _FF7ZR_FILT_DATA) {
+			return r;
+		}
+	}
+	*byte = (ffbyte)s->data.ptr[0];
+	ffstr_shift(&s->data, 1);
+	return _FF7ZR_FILT_DATA;
+}
+
+#define _FF7ZR_BCJ2_IS_J(b0, b1) \
+	(((b1) & 0xfe) == 0xe8 || ((b0) == 0x0f && ((b1) & 0xf0) == 0x80))
+
+/** Restore the absolute addresses of x86 CALL/JMP/Jcc instructions, moved out to separate streams */
+static int _ff7zr_bcj2_process(struct z7_filter *c)
+{
+	struct _ff7zr_bcj2 *b = c->bcj2;
+	ffbyte *out = (ffbyte*)c->buf.ptr;
+	ffuint x;
+	int r;
+
+	for (;;) {
+		if (b->out_pos == b->out_size) {
+			if (c->buf.len != 0)
+				return _FF7ZR_FILT_DATA;
+			return _FF7ZR_FILT_DONE;
+		}
+		if (c->buf.len + 4 > c->buf.cap)
+			return _FF7ZR_FILT_DATA;
+
+		switch (b->state) {
+		case _FF7ZR_BCJ2_INIT:
+			if (_FF7ZR_FILT_DATA != (r = _ff7zr_bcj2_byte(c, 2, &x)))
+				return r;
+			b->code = (b->code << 8) | x;
+			if (++b->n == 5)
+				b->state = _FF7ZR_BCJ2_COPY;
+			break;
+
+		case _FF7ZR_BCJ2_COPY: {
+			if (c->in.len == 0) {
+				if (c->buf.len != 0)
+					return _FF7ZR_FILT_DATA;
+				if (c->fin) {
+					c->err = Z7_EDATA;
+					return _FF7ZR_FILT_ERR;
+				}
+				return _FF7ZR_FILT_MORE;
+			}
+
+			const ffbyte *in = (ffbyte*)c->in.ptr;
+			ffsize i, n = ffmin(c->in.len, c->buf.cap - c->buf.len);
+			n = ffmin(n, b->out_size - b->out_pos);
+			for (i = 0;  i != n;  i++) {
+				x = in[i];
+				out[c->buf.len++] = x;
+				if (_FF7ZR_BCJ2_IS_J(b->prev, x)) {
+					b->op = x;
+					b->state = _FF7ZR_BCJ2_BIT;
+					i++;
+					break;
+				}
+				b->prev = x;
+			}
+			ffstr_shift(&c->in, i);
+			b->out_pos += i;
+			break;
+		}
+
+		case _FF7ZR_BCJ2_BIT: {
+			ffushort *prob = &b->probs[(b->op == 0xe8) ? b->prev
+				: (b->op == 0xe9) ? 256 : 257];
+			ffuint bound = (b->range >> 11) * *prob;
+			b->bit = (b->code >= bound);
+			if (!b->bit) {
+				b->range = bound;
+				*prob += (2048 - *prob) >> 5;
+			} else {
+				b->range -= bound;
+				b->code -= bound;
+				*prob -= *prob >> 5;
+			}
+			b->state = _FF7ZR_BCJ2_NORM;
+		}
+			// fallthrough
+
+		case _FF7ZR_BCJ2_NORM:
+			if (b->range < (1U << 24)) {
+				if (_FF7ZR_FILT_DATA != (r = _ff7zr_bcj2_byte(c, 2, &x)))
+					return r;
+				b->range <<= 8;
+				b->code = (b->code << 8) | x;
+			}
+			if (!b->bit) {
+				b->prev = b->op;
+				b->state = _FF7ZR_BCJ2_COPY;
+				break;
+			}
+			b->state = _FF7ZR_BCJ2_ADDR;
+			b->n = 0;
+			b->src = 0;
+			// fallthrough
+
+		case _FF7ZR_BCJ2_ADDR: {
+			if (_FF7ZR_FILT_DATA != (r = _ff7zr_bcj2_byte(c, (b->op == 0xe8) ? 0 : 1, &x)))
+				return r;
+			b->src = (b->src << 8) | x;
+			if (++b->n != 4)
+				break;
+
+			ffuint dest = b->src - (ffuint)(b->out_pos + 4);
+			ffuint n = ffmin(4, b->out_size - b->out_pos);
+			for (ffuint i = 0;  i != n;  i++) {
+				out[c->buf.len++] = (ffbyte)(dest >> (i * 8));
+			}
+			b->out_pos += n;
+			b->prev = (ffbyte)(dest >> 24);
+			b->state = _FF7ZR_BCJ2_COPY;
+			break;
+		}
+		}
+	}
+}
+
+#undef _FF7ZR_BCJ2_IS_J
+
+
 /** Cut data by absolute boundaries
 Return the number of bytes processed from the beginning
 
@@ -478,6 +1024,8 @@ static int _ff7zread_filters_call(ff7zread *z, ffstr *output)
 		ffstr_set2(&next->in, &c->buf);
 		c->buf.len = 0;
 		z->ifilter++;
+		if (z->cache_limit != 0 && z->state == R_FDATA && z->ifilter + 1 == z->_filters.len)
+			_ff7zread_cache_add(z, next->read, next->in);
 		break;
 
 	case _FF7ZR_FILT_DONE:
@@ -496,10 +1044,11 @@ static int _ff7zread_filters_call(ff7zread *z, ffstr *output)
 		break;
 
 	case _FF7ZR_FILT_SEEK:
-		if (z->ifilter != 0)
-			return _ERR(z, 0);
 		return FF7ZREAD_SEEK;
 
+	case _FF7ZR_FILT_INPUT:
+		return FF7ZREAD_MORE;
+
 	case _FF7ZR_FILT_ERR:
 		return _ERR(z, c->err);
 	}
@@ -548,15 +1097,32 @@ static int _ff7zread_prep_unpack_file(ff7zread *z)
 		z->state = R_FDONE;
 		return 0;
 	}
+	z->crc = 0;
+	if (0 == _ff7zread_cache_fileopen(z, f)) {
+		_ff7zread_log(z, 0, "reading from cache");
+		z->state = R_FCACHE;
+		return 0;
+	}
 	z->state = R_FDATA;
 
-	z->crc = 0;
+	if (z->_filters.len != 0
+		&& z->filters[z->_filters.len - 1].read > f->off) {
+		// the file data is already passed: decode the folder from the beginning
+		_ff7zread_filters_close(z);
+		z->cache_cur.len = 0;
+	}
+
 	if (z->_filters.len == 0) {
 		if (0 != (r = _ff7zread_filters_create(z, z->cur_folder)))
 			return _ERR(z, r);
 		z->filters[z->_filters.len - 1].bounds.off = f->off;
 		z->filters[z->_filters.len - 1].bounds.size = f->size;
-		z->off = z->cur_folder->coder[0].stream.off;
+#ifdef FFPACK_7ZREAD_THREADS
+		if (z->pipeline
+			&& 0 != (r = _ff7zread_pipe_start(z)))
+			return _ERR(z, r);
+#endif
+		z->off = z->filters[0].input.off;
 		return FF7ZREAD_SEEK;
 	}
 
@@ -624,7 +1190,8 @@ static inline int ff7zread_process(ff7zread *z, ffstr *input, ffstr *output)
 {
 	int r;
 	z->input = input;
-	_ff7z_log_param = z;
+	if (z->state < R_FSTART)
+		_ff7z_log_param = z; // only for meta parsing, so the folder readers don't touch it
 
 	for (;;) {
 		switch (z->state) {
@@ -664,6 +1231,10 @@ static inline int ff7zread_process(ff7zread *z, ffstr *input, ffstr *output)
 			if (z->gdata.len == 0) {
 				if (z->iblk != 0)
 					return _ERR(z, Z7_EDATA);
+				// the file list doesn't refer to the header data
+				ffvec_free(&z->buf);
+				ffvec_free(&z->gbuf);
+				ffstr_null(&z->gdata);
 				z->cur_folder = (struct z7_folder*)z->folders.ptr;
 				return FF7ZREAD_FILEHEADER;
 			}
@@ -729,7 +1300,13 @@ static inline int ff7zread_process(ff7zread *z, ffstr *input, ffstr *output)
 			continue;
 
 		case R_FDATA:
-			if (0 == (r = _ff7zread_filters_call(z, output)))
+#ifdef FFPACK_7ZREAD_THREADS
+			if (z->pipe != NULL)
+				r = _ff7zread_pipe_call(z, output);
+			else
+#endif
+				r = _ff7zread_filters_call(z, output);
+			if (r == 0)
 				continue;
 
 			if (r == FF7ZREAD_FILEDONE)
@@ -740,6 +1317,22 @@ static inline int ff7zread_process(ff7zread *z, ffstr *input, ffstr *output)
 			z->state = R_FNEXT;
 			return FF7ZREAD_FILEDONE;
 
+		case R_FCACHE: {
+			if (z->cache_off != z->cache_end) {
+				if (0 != _ff7zread_cache_read(z, output))
+					return _ERR(z, Z7_EDATA);
+				z->crc = crc32((void*)output->ptr, output->len, z->crc);
+				return FF7ZREAD_DATA;
+			}
+
+			const ff7zread_fileinfo *f = (ff7zread_fileinfo*)z->cur_folder->files.ptr;
+			f = &f[z->cur_folder->ifile - 1];
+			if (f->crc != z->crc)
+				return _ERR(z, Z7_EDATACRC);
+			z->state = R_FNEXT;
+			return FF7ZREAD_FILEDONE;
+		}
+
 		case R_FNEXT:
 			return FF7ZREAD_FILEHEADER;
 
@@ -759,6 +1352,7 @@ static inline const ff7zread_fileinfo* ff7zread_nextfile(ff7zread *z)
 		if (z->cur_folder == ffslice_lastT(&z->folders, struct z7_folder))
 			return NULL;
 		_ff7zread_filters_close(z);
+		z->cache_cur.len = 0;
 		z->cur_folder->ifile = 0;
 		z->cur_folder++;
 	}
@@ -767,3 +1361,275 @@ static inline const ff7zread_fileinfo* ff7zread_nextfile(ff7zread *z)
 	z->state = R_FSTART;
 	return &f[z->cur_folder->ifile++];
 }
+
+/** Prepare for reading the specified file (in any order).
+Reading a file that precedes the current position in a solid folder
+ restarts decoding of the folder (unless its data is in cache: see 'cache_limit').
+ff7zread_nextfile() then continues with the next file.
+Return NULL if there's no such file */
+static inline const ff7zread_fileinfo* ff7zread_fileopen(ff7zread *z, ffsize ifolder, ffsize ifile)
+{
+	if (z->cur_folder == NULL || ifolder >= z->folders.len)
+		return NULL;
+	struct z7_folder *fo = &((struct z7_folder*)z->folders.ptr)[ifolder];
+	if (ifile >= fo->files.len)
+		return NULL;
+
+	if (fo != z->cur_folder) {
+		_ff7zread_filters_close(z);
+		z->cache_cur.len = 0;
+		z->cur_folder->ifile = 0;
+		z->cur_folder = fo;
+	}
+
+	fo->ifile = ifile + 1;
+	z->state = R_FSTART;
+	return &((ff7zread_fileinfo*)fo->files.ptr)[ifile];
+}
+
+/** Prepare for reading the file by its index (in the order of ff7zread_nextfile()).
+Only the folder containing the file is decoded, and only up to the file's data.
+Return NULL if there's no such file */
+static inline const ff7zread_fileinfo* ff7zread_select(ff7zread *z, ffsize index)
+{
+	const struct z7_folder *fo;
+	ffsize i = 0;
+	FFSLICE_WALK(&z->folders, fo) {
+		if (index < fo->files.len)
+			return ff7zread_fileopen(z, i, index);
+		index -= fo->files.len;
+		i++;
+	}
+	return NULL;
+}
+
+/** Find file by name
+Return file index for ff7zread_select()
+  -1: not found */
+static inline ffssize ff7zread_find(ff7zread *z, ffstr name)
+{
+	const struct z7_folder *fo;
+	ffsize index = 0;
+	FFSLICE_WALK(&z->folders, fo) {
+		const ff7zread_fileinfo *f;
+		FFSLICE_WALK(&fo->files, f) {
+			if (ffstr_eq2(&f->name, &name))
+				return index;
+			index++;
+		}
+	}
+	return -1;
+}
+
+/** Get the number of folders (independently compressed blocks).
+The last folder may contain only empty files and directories. */
+#define ff7zread_folders(z)  ((z)->folders.len)
+
+static int _ff7zread_folder_size_cmp(const void *a, const void *b, void *udata)
+{
+	const struct z7_folder *fo = (struct z7_folder*)udata;
+	ffuint64 sa = fo[*(ffuint*)a].unpack_size, sb = fo[*(ffuint*)b].unpack_size;
+	return (sa < sb) ? 1 : (sa > sb) ? -1 : 0;
+}
+
+/** Get folder indexes sorted by unpacked size (largest first),
+ so that parallel workers taking the next folder from this list finish at about the same time.
+order: (output) ffuint[] */
+static inline int ff7zread_folders_order(ff7zread *z, ffvec *order)
+{
+	order->len = 0;
+	if (NULL == ffvec_allocT(order, z->folders.len, ffuint))
+		return -1;
+	for (ffuint i = 0;  i != z->folders.len;  i++) {
+		*ffvec_pushT(order, ffuint) = i;
+	}
+	ffsort(order->ptr, order->len, sizeof(ffuint), _ff7zread_folder_size_cmp, z->folders.ptr);
+	return 0;
+}
+
+/** Prepare for extracting the files of one folder independently of the other folders.
+Each worker thread uses its own ff7zread object with its own filter chain,
+ while the file list of 'parent' is shared read-only.
+'parent' must have returned FF7ZREAD_FILEHEADER and must not be closed before 'z'.
+Then the caller uses ff7zread_nextfile() and ff7zread_process() as usual
+ (until ff7zread_nextfile() returns NULL), reading input data at the returned offsets (e.g. pread()).
+Return 0 on success */
+static inline int ff7zread_open_folder(ff7zread *z, const ff7zread *parent, ffsize i)
+{
+	if (i >= parent->folders.len)
+		return -1;
+	ffmem_zero_obj(z);
+	if (NULL == ffvec_allocT(&z->folders, 1, struct z7_folder))
+		return -1;
+	struct z7_folder *fo = (struct z7_folder*)z->folders.ptr;
+	*fo = ((struct z7_folder*)parent->folders.ptr)[i];
+	fo->files.cap = 0; // don't own the data
+	ffvec_null(&fo->empty);
+	ffvec_null(&fo->file_arena);
+	ffvec_null(&fo->name_arena);
+	fo->ifile = 0;
+	z->folders.len = 1;
+	z->folder_clone = 1;
+	z->cur_folder = fo;
+	z->state = R_FNEXT;
+	z->log = parent->log;
+	z->udata = parent->udata;
+	return 0;
+}
+
+
+/** Get the packed stream area and LZMA2 properties of a folder compressed only with LZMA2,
+ for decoding it in parallel with ff7zread_lzma2_split() and ff7zread_lzma2_decode().
+prop: (output) LZMA2 dictionary size property
+Return 0 on success */
+static inline int ff7zread_folder_lzma2(ff7zread *z, ffsize ifolder, ffuint64 *off, ffuint64 *size, ffbyte *prop)
+{
+	if (ifolder >= z->folders.len)
+		return -1;
+	const struct z7_folder *fo = &((struct z7_folder*)z->folders.ptr)[ifolder];
+	const struct z7_coder *cod = &fo->coder[0];
+	if (fo->coders != 1
+		|| cod->method != Z7_M_LZMA2
+		|| cod->nprops != 1
+		|| cod->stream.off == 0)
+		return -1;
+	*off = cod->stream.off;
+	*size = cod->stream.pack_size;
+	*prop = cod->props[0];
+	return 0;
+}
+
+typedef struct ff7zread_lzma2_seg {
+	ffuint64 off, size; // area within LZMA2 data
+	ffuint64 unpacked_off, unpacked_size; // area within unpacked data
+} ff7zread_lzma2_seg_t;
+
+static int _ff7zread_lzma2_seg_add(ffvec *segs, ffuint64 off, ffuint64 unpacked_off)
+{
+	ff7zread_lzma2_seg_t *sg;
+	if (segs->len != 0) {
+		sg = ffslice_lastT(segs, ff7zread_lzma2_seg_t);
+		if (off == sg->off)
+			return 0;
+		sg->size = off - sg->off;
+		sg->unpacked_size = unpacked_off - sg->unpacked_off;
+	}
+	if (NULL == (sg = ffvec_pushT(segs, ff7zread_lzma2_seg_t)))
+		return -1;
+	sg->off = off;
+	sg->unpacked_off = unpacked_off;
+	return 0;
+}
+
+/** Split LZMA2 data into segments that can be decoded independently (e.g. by worker threads).
+A segment starts at a chunk that resets the dictionary
+ (as written by multi-threaded encoders for each block).
+An uncompressed chunk with dictionary reset starts a segment too:
+ the LZMA chunk following it must set new properties, so a new decoder gets them.
+Such split point is confirmed by the next LZMA chunk with properties or by the end of data.
+segs: (output) ff7zread_lzma2_seg_t[]
+Return 0 on success */
+static inline int ff7zread_lzma2_split(ffstr data, ffvec *segs)
+{
+	segs->len = 0;
+	ffuint64 off = 0, unpacked = 0;
+	ffuint64 pending_off = (ffuint64)-1, pending_unpacked = 0;
+
+	for (;;) {
+		if (off >= data.len)
+			return -1; // no end marker
+		const ffbyte *d = (ffbyte*)data.ptr + off;
+		ffuint c = d[0];
+		ffuint hdr, psize, usize;
+
+		if (c == 0) {
+			if (pending_off != (ffuint64)-1
+				&& 0 != _ff7zread_lzma2_seg_add(segs, pending_off, pending_unpacked))
+				return -1;
+			break;
+
+		} else if (c == 1 || c == 2) {
+			hdr = 3;
+			if (off + hdr > data.len)
+				return -1;
+			psize = usize = ffint_be_cpu16_ptr(d + 1) + 1;
+
+		} else if (c >= 0x80) {
+			hdr = (c >= 0xc0) ? 6 : 5;
+			if (off + hdr > data.len)
+				return -1;
+			usize = ((c & 0x1f) << 16) + ffint_be_cpu16_ptr(d + 1) + 1;
+			psize = ffint_be_cpu16_ptr(d + 3) + 1;
+
+		} else {
+			return -1;
+		}
+
+		if (c == 1 || c >= 0xc0) {
+			// the previous uncompressed chunk with dictionary reset is a valid split point
+			if (pending_off != (ffuint64)-1
+				&& 0 != _ff7zread_lzma2_seg_add(segs, pending_off, pending_unpacked))
+				return -1;
+			pending_off = (ffuint64)-1;
+		} else if (c >= 0x80) {
+			pending_off = (ffuint64)-1; // LZMA chunk needs the properties from the previous chunks
+		}
+
+		if (off == 0 || c >= 0xe0) {
+			if (0 != _ff7zread_lzma2_seg_add(segs, off, unpacked))
+				return -1;
+		} else if (c == 1) {
+			pending_off = off;
+			pending_unpacked = unpacked;
+		}
+
+		off += hdr + psize;
+		unpacked += usize;
+	}
+
+	if (segs->len == 0)
+		return 0;
+	ff7zread_lzma2_seg_t *sg = ffslice_lastT(segs, ff7zread_lzma2_seg_t);
+	sg->size = off - sg->off;
+	sg->unpacked_size = unpacked - sg->unpacked_off;
+	return 0;
+}
+
+/** Decode one segment of LZMA2 data
+prop: LZMA2 dictionary size property
+seg: segment data
+dst: output buffer of segment's unpacked size
+Return 0 on success */
+static inline int ff7zread_lzma2_decode(ffbyte prop, ffstr seg, void *dst, ffsize cap)
+{
+	int rc = -1;
+	lzma_decoder *dec;
+	lzma_filter_props fp = {};
+	fp.id = LZMA_FILT_LZMA2;
+	fp.props = (char*)&prop;
+	fp.prop_len = 1;
+	if (0 != lzma_decode_init(&dec, 0, &fp, 1))
+		return -1;
+
+	ffsize w = 0;
+	while (seg.len != 0 || w != cap) {
+		ffsize n = seg.len;
+		int r = lzma_decode(dec, seg.ptr, &n, (char*)dst + w, cap - w);
+		if (r < 0)
+			goto end; // error or unexpected end of data
+		ffstr_shift(&seg, n);
+		if (r == 0 && n == 0)
+			goto end; // no progress: not enough data or too small buffer
+		w += r;
+	}
+	rc = 0;
+
+end:
+	lzma_decode_free(dec);
+	return rc;
+}
+
+
+#ifdef FFPACK_7ZREAD_THREADS
+	#include <ffpack/7z-read-pipe.h>
+#endif
@@ -0,0 +1,931 @@
+/** ffpack: .7z writer
+* coders: store, LZMA2, zstd
+* solid blocks: limited by size or by file extension
+* header is compressed with LZMA2 (EncodedHeader)
+* blocks may be compressed independently (e.g. by worker threads) with ff7zwrite_block_compress()
+2024, Simon Zolin */
+
+/*
+ff7zwrite_destroy
+ff7zwrite_fileadd
+ff7zwrite_block_compress
+ff7zwrite_block_add
+ff7zwrite_block_free
+ff7zwrite_filefinish
+ff7zwrite_process
+ff7zwrite_offset
+ff7zwrite_finish
+ff7zwrite_error
+*/
+
+/* .7z output:
+SIG_HDR(placeholder)
+STREAM_PACKED(FILE_DATA...)...
+META_PACKED(META)
+META_HDR(EncodedHeader)
+SIG_HDR
+*/
+
+#pragma once
+
+#include <ffpack/7z-read.h>
+#include <lzma/lzma-ff.h>
+#include <zstd/zstd-ff.h>
+#include <ffbase/vector.h>
+
+typedef struct ff7zwrite_coder_conf {
+	ffuint method; // enum Z7_METHOD: Z7_M_LZMA2 (default), Z7_M_ZSTD, Z7_M_STORE
+	ffuint lzma_preset; // 0:default
+	ffuint lzma_dict_size; // 0:default
+	int zstd_level; // 0:default
+	ffuint zstd_workers;
+} ff7zwrite_coder_conf;
+
+#define _FF7ZW_MAX_PROPS  5
+
+/** Folder encoder */
+struct _ff7zw_coder {
+	ffuint method;
+	lzma_encoder *lzma;
+	zstd_encoder *zstd;
+};
+
+static void _ff7zw_coder_close(struct _ff7zw_coder *c);
+
+struct _ff7zw_folder {
+	ffuint method; // enum Z7_METHOD
+	ffuint nprops;
+	char props[_FF7ZW_MAX_PROPS];
+	ffuint64 pack_size, unpack_size;
+	ffuint64 files; // N of non-empty files
+	ffstr ext; // extension of the first file
+};
+
+typedef struct ff7zwrite ff7zwrite;
+struct ff7zwrite {
+	ffuint state, next_state;
+	const char *error;
+	ffvec buf;
+	ffvec files; // struct _ff7zw_file[]
+	ffvec folders; // struct _ff7zw_folder[]
+	struct _ff7zw_folder folder; // current folder
+	ffuint folder_open;
+	struct _ff7zw_coder coder_cur;
+	ffuint file_added, file_fin, arc_fin;
+	ffuint64 file_size;
+	ffuint file_crc;
+	struct ff7zwrite_block *block; // pending block from ff7zwrite_block_add()
+	ffuint64 total_wr;
+	ffuint64 offset;
+	struct z7_info info;
+
+	ff7zwrite_coder_conf coder;
+
+	/* Unpacked size of a solid block (folder) after which a new block is started;  0:unlimited
+	The block is closed only at a file boundary, so it may exceed this size by up to one file. */
+	ffuint64 solid_size;
+
+	/* Start a new solid block when file extension changes */
+	ffuint solid_ext;
+};
+
+typedef struct ff7zwrite_conf {
+	ffstr name;
+	fftime mtime; // seconds since 1970
+	ffuint attr; // Windows file attributes (0x10: directory)
+} ff7zwrite_conf;
+
+/** Solid block compressed independently of the writer object */
+typedef struct ff7zwrite_block {
+	ffvec data; // packed data
+	ffvec sizes; // ffuint64[]: unpacked size of each file
+	ffvec crcs; // ffuint[]: CRC of each file
+	ffuint method; // enum Z7_METHOD
+	ffuint nprops;
+	char props[_FF7ZW_MAX_PROPS];
+	ffuint64 unpack_size;
+} ff7zwrite_block;
+
+/** Prepare for writing the next file
+Directories and files without data are stored as empty streams.
+Return 0 on success
+  <0 on error
+  -2 if normalized file name is empty (.e.g. for "/" or "." or "..") */
+static int ff7zwrite_fileadd(ff7zwrite *w, const ff7zwrite_conf *conf);
+
+/** Compress data of several files as one solid block.
+Doesn't use any writer object, so several blocks may be compressed in parallel by worker threads,
+ then added in the needed order with ff7zwrite_block_add().
+data: data of each file
+blk: (output)
+Return 0 on success */
+static int ff7zwrite_block_compress(const ff7zwrite_coder_conf *conf, const ffstr *data, ffsize n, ff7zwrite_block *blk);
+
+/** Add the files compressed with ff7zwrite_block_compress().
+The block is written by ff7zwrite_process() until FF7ZWRITE_FILEDONE.
+'blk' must stay valid until then.
+confs: file info for each file in block
+Return 0 on success */
+static int ff7zwrite_block_add(ff7zwrite *w, const ff7zwrite_conf *confs, ffsize n, ff7zwrite_block *blk);
+
+static inline void ff7zwrite_block_free(ff7zwrite_block *blk)
+{
+	ffvec_free(&blk->data);
+	ffvec_free(&blk->sizes);
+	ffvec_free(&blk->crcs);
+}
+
+/** Close writer */
+static void ff7zwrite_destroy(ff7zwrite *w);
+
+enum FF7ZWRITE_R {
+	/* Need more input data
+	Expecting ff7zwrite_process() with more data or ff7zwrite_filefinish() */
+	FF7ZWRITE_MORE,
+
+	/* Have more output data for user
+	Expecting ff7zwrite_process() */
+	FF7ZWRITE_DATA,
+
+	/* The next output data must be written at offset ff7zwrite_offset()
+	Expecting ff7zwrite_process() */
+	FF7ZWRITE_SEEK,
+
+	/* Finished processing the current file
+	Expecting ff7zwrite_fileadd(), ff7zwrite_block_add() or ff7zwrite_finish() */
+	FF7ZWRITE_FILEDONE,
+
+	/* Finished writing .7z file */
+	FF7ZWRITE_DONE,
+
+	/* Fatal error */
+	FF7ZWRITE_ERROR,
+};
+
+/** Write the next chunk
+output: pointer to an empty string for the output data
+Return enum FF7ZWRITE_R */
+static int ff7zwrite_process(ff7zwrite *w, ffstr *input, ffstr *output);
+
+/** Get output offset
+After FF7ZWRITE_DONE: the archive size */
+static inline ffuint64 ff7zwrite_offset(ff7zwrite *w)
+{
+	return w->offset;
+}
+
+/** Input data for the current file is finished */
+static inline void ff7zwrite_filefinish(ff7zwrite *w)
+{
+	w->file_fin = 1;
+}
+
+/** All input data is finished */
+static inline void ff7zwrite_finish(ff7zwrite *w)
+{
+	w->arc_fin = 1;
+}
+
+/** Get last error message */
+static inline const char* ff7zwrite_error(ff7zwrite *w)
+{
+	return w->error;
+}
+
+
+#define _FF7ZWRITE_BUFCAP  (64*1024)
+
+struct _ff7zw_file {
+	ffstr name;
+	fftime mtime;
+	ffuint attr;
+	ffuint crc;
+	ffuint64 size;
+};
+
+static inline void ff7zwrite_destroy(ff7zwrite *w)
+{
+	struct _ff7zw_file *f;
+	FFSLICE_WALK(&w->files, f) {
+		ffstr_free(&f->name);
+	}
+	ffvec_free(&w->files);
+	struct _ff7zw_folder *fo;
+	FFSLICE_WALK(&w->folders, fo) {
+		ffstr_free(&fo->ext);
+	}
+	ffvec_free(&w->folders);
+	ffstr_free(&w->folder.ext);
+	_ff7zw_coder_close(&w->coder_cur);
+	ffvec_free(&w->buf);
+}
+
+/** Get file extension */
+static inline ffstr _ff7zw_ext(ffstr name)
+{
+	ffstr ext = {};
+	ffssize i = ffs_rfindchar(name.ptr, name.len, '.');
+	if (i >= 0 && ffs_rfindchar(name.ptr, name.len, '/') < i)
+		ffstr_set(&ext, name.ptr + i + 1, name.len - i - 1);
+	return ext;
+}
+
+/** Add file entry
+Return 0 on success;  <0 on error */
+static inline int _ff7zw_file_add(ff7zwrite *w, const ff7zwrite_conf *conf)
+{
+	struct _ff7zw_file *f;
+	if (NULL == (f = ffvec_zpushT(&w->files, struct _ff7zw_file)))
+		return -1;
+
+	int rc = -1;
+	if (NULL == ffstr_alloc(&f->name, conf->name.len + 1))
+		goto err;
+	f->name.len = _ffpack_path_normalize(f->name.ptr, conf->name.len, conf->name.ptr, conf->name.len, _FFPACK_PATH_FORCE_SLASH | _FFPACK_PATH_SIMPLE);
+	if (f->name.len != 0 && f->name.ptr[f->name.len - 1] == '/')
+		f->name.len--;
+	if (f->name.len == 0) {
+		rc = -2;
+		goto err;
+	}
+
+	f->mtime = conf->mtime;
+	f->attr = conf->attr;
+	return 0;
+
+err:
+	ffstr_free(&f->name);
+	w->files.len--;
+	return rc;
+}
+
+static inline int ff7zwrite_fileadd(ff7zwrite *w, const ff7zwrite_conf *conf)
+{
+	int r;
+	if (w->file_added || w->block != NULL)
+		return -1;
+
+	if (0 != (r = _ff7zw_file_add(w, conf)))
+		return r;
+	w->file_added = 1;
+	return 0;
+}
+
+/** Initialize folder encoder
+props: (output) coder properties
+Return N of bytes in 'props';  <0 on error */
+static inline int _ff7zw_coder_open(struct _ff7zw_coder *c, const ff7zwrite_coder_conf *conf, ffuint method, char *props)
+{
+	ffmem_zero_obj(c);
+	c->method = method;
+	switch (method) {
+	case Z7_M_LZMA2: {
+		lzma_enc_conf lc = {};
+		lc.preset = conf->lzma_preset;
+		lc.dict_size = conf->lzma_dict_size;
+		if (0 != lzma_encode_init(&c->lzma, &lc, props))
+			return -1;
+		return 1;
+	}
+
+	case Z7_M_ZSTD: {
+		zstd_enc_conf zc = {};
+		zc.level = (conf->zstd_level != 0) ? conf->zstd_level : 3;
+		zc.workers = conf->zstd_workers;
+		if (0 != zstd_encode_init(&c->zstd, &zc))
+			return -1;
+		// version of zstd library;  compression level;  reserved
+		const char zprops[_FF7ZW_MAX_PROPS] = { 1, 5, (char)zc.level, 0, 0 };
+		ffmem_copy(props, zprops, _FF7ZW_MAX_PROPS);
+		return _FF7ZW_MAX_PROPS;
+	}
+	}
+	return -1;
+}
+
+static inline void _ff7zw_coder_close(struct _ff7zw_coder *c)
+{
+	lzma_encode_free(c->lzma);  c->lzma = NULL;
+	zstd_encode_free(c->zstd);  c->zstd = NULL;
+}
+
+/** Encode data
+fin: no more input data
+Return N of bytes written to 'dst';
+  0: need more input data (fin=0) or the encoder is flushed (fin=1);
+  <0 on error */
+static inline ffssize _ff7zw_coder_process(struct _ff7zw_coder *c, ffstr *input, char *dst, ffsize cap, ffuint fin)
+{
+	int r;
+	switch (c->method) {
+	case Z7_M_LZMA2: {
+		ffsize n = input->len;
+		r = lzma_encode(c->lzma, input->ptr, &n, dst, cap, (fin) ? LZMA_FFINISH : 0);
+		ffstr_shift(input, n);
+		if (r == LZMA_DONE)
+			return 0;
+		return r;
+	}
+
+	case Z7_M_ZSTD: {
+		zstd_buf in, out;
+		zstd_buf_set(&in, input->ptr, input->len);
+		zstd_buf_set(&out, dst, cap);
+		r = zstd_encode(c->zstd, &in, &out, (fin) ? ZSTD_FFINISH : 0);
+		ffstr_shift(input, in.pos);
+		if (r < 0)
+			return -1;
+		return out.pos;
+	}
+	}
+	return -1;
+}
+
+/** Compress data in one call */
+static inline int _ff7zw_compress(const ff7zwrite_coder_conf *conf, ffuint method, const ffstr *data, ffsize n, ffvec *out, char *props, ffuint *nprops)
+{
+	int r, rc = -1;
+	struct _ff7zw_coder c;
+	if (0 > (r = _ff7zw_coder_open(&c, conf, method, props)))
+		goto end;
+	*nprops = r;
+
+	ffsize i = 0;
+	ffstr in = {};
+	if (n != 0)
+		in = data[0];
+	for (;;) {
+		while (in.len == 0 && i + 1 < n) {
+			in = data[++i];
+		}
+
+		if (NULL == ffvec_growT(out, _FF7ZWRITE_BUFCAP, char))
+			goto end;
+
+		ffuint fin = (in.len == 0);
+		ffssize k = _ff7zw_coder_process(&c, &in, ffslice_endT(out, char), ffvec_unused(out), fin);
+		if (k < 0)
+			goto end;
+		if (k == 0 && fin)
+			break;
+		out->len += k;
+	}
+	rc = 0;
+
+end:
+	_ff7zw_coder_close(&c);
+	return rc;
+}
+
+static inline int ff7zwrite_block_compress(const ff7zwrite_coder_conf *conf, const ffstr *data, ffsize n, ff7zwrite_block *blk)
+{
+	ffmem_zero_obj(blk);
+	blk->method = (conf->method != 0) ? conf->method : Z7_M_LZMA2;
+
+	if (NULL == ffvec_allocT(&blk->sizes, n, ffuint64)
+		|| NULL == ffvec_allocT(&blk->crcs, n, ffuint))
+		goto err;
+	for (ffsize i = 0;  i != n;  i++) {
+		*ffvec_pushT(&blk->sizes, ffuint64) = data[i].len;
+		*ffvec_pushT(&blk->crcs, ffuint) = crc32((void*)data[i].ptr, data[i].len, 0);
+		blk->unpack_size += data[i].len;
+	}
+
+	switch (blk->method) {
+	case Z7_M_STORE:
+		if (NULL == ffvec_allocT(&blk->data, blk->unpack_size, char))
+			goto err;
+		for (ffsize i = 0;  i != n;  i++) {
+			ffvec_add2T(&blk->data, &data[i], char);
+		}
+		break;
+
+	default:
+		if (0 != _ff7zw_compress(conf, blk->method, data, n, &blk->data, blk->props, &blk->nprops))
+			goto err;
+	}
+	return 0;
+
+err:
+	ff7zwrite_block_free(blk);
+	return -1;
+}
+
+static inline int ff7zwrite_block_add(ff7zwrite *w, const ff7zwrite_conf *confs, ffsize n, ff7zwrite_block *blk)
+{
+	if (w->file_added || w->block != NULL
+		|| n != blk->sizes.len)
+		return -1;
+
+	ffsize nfiles = w->files.len;
+	for (ffsize i = 0;  i != n;  i++) {
+		if (0 != _ff7zw_file_add(w, &confs[i])) {
+			for (ffsize k = nfiles;  k != w->files.len;  k++) {
+				ffstr_free(&ffslice_itemT(&w->files, k, struct _ff7zw_file)->name);
+			}
+			w->files.len = nfiles;
+			return -1;
+		}
+		struct _ff7zw_file *f = ffslice_lastT(&w->files, struct _ff7zw_file);
+		f->size = *ffslice_itemT(&blk->sizes, i, ffuint64);
+		f->crc = *ffslice_itemT(&blk->crcs, i, ffuint);
+	}
+
+	w->block = blk;
+	return 0;
+}
+
+static inline void _ff7zw_byte(ffvec *b, ffuint val)
+{
+	char c = (char)val;
+	ffvec_addT(b, &c, 1, char);
+}
+
+static inline void _ff7zw_int(ffvec *b, ffuint64 val)
+{
+	char n[9];
+	ffvec_addT(b, n, z7_varint_write(n, val), char);
+}
+
+static inline void _ff7zw_int32(ffvec *b, ffuint val)
+{
+	ffuint n = ffint_le_cpu32(val);
+	ffvec_addT(b, &n, 4, char);
+}
+
+/** Write 1 folder description */
+static inline void _ff7zw_folder_write(ffvec *b, const struct _ff7zw_folder *fo)
+{
+	_ff7zw_int(b, 1); // NumCoders
+	const char *id = z7_method[fo->method - 1];
+	ffuint idlen = 1;
+	while (idlen != 4 && id[idlen] != 0x00) {
+		idlen++;
+	}
+	_ff7zw_byte(b, idlen | ((fo->nprops != 0) ? FOLDER_F_ATTRS : 0));
+	ffvec_addT(b, id, idlen, char);
+	if (fo->nprops != 0) {
+		_ff7zw_int(b, fo->nprops);
+		ffvec_addT(b, fo->props, fo->nprops, char);
+	}
+}
+
+/** Write the ID and the space for the size of an item property (Z7_F_SIZE) and return its offset */
+static inline ffsize _ff7zw_prop_begin(ffvec *b, ffuint id)
+{
+	static const char reserved[9] = {}; // space for the max. size
+	_ff7zw_byte(b, id);
+	ffsize off = b->len;
+	ffvec_addT(b, reserved, 9, char);
+	return off;
+}
+
+static inline void _ff7zw_prop_end(ffvec *b, ffsize off)
+{
+	char n[9];
+	ffuint k = z7_varint_write(n, b->len - off - 9);
+	ffmem_move((char*)b->ptr + off + k, (char*)b->ptr + off + 9, b->len - off - 9);
+	ffmem_copy((char*)b->ptr + off, n, k);
+	b->len -= 9 - k;
+}
+
+/** Build the header */
+static inline int _ff7zw_hdr_write(ff7zwrite *w, ffvec *b)
+{
+	const struct _ff7zw_file *f, *files = (struct _ff7zw_file*)w->files.ptr;
+	const struct _ff7zw_folder *fo;
+
+	_ff7zw_byte(b, Z7_T_Header);
+
+	if (w->folders.len != 0) {
+		_ff7zw_byte(b, Z7_T_MainStreamsInfo);
+
+		_ff7zw_byte(b, Z7_T_PackInfo);
+		_ff7zw_int(b, 0);
+		_ff7zw_int(b, w->folders.len);
+		_ff7zw_byte(b, Z7_T_Size);
+		FFSLICE_WALK(&w->folders, fo) {
+			_ff7zw_int(b, fo->pack_size);
+		}
+		_ff7zw_byte(b, Z7_T_End);
+
+		_ff7zw_byte(b, Z7_T_UnPackInfo);
+		_ff7zw_byte(b, Z7_T_Folder);
+		_ff7zw_int(b, w->folders.len);
+		_ff7zw_byte(b, 0); // External
+		FFSLICE_WALK(&w->folders, fo) {
+			_ff7zw_folder_write(b, fo);
+		}
+		_ff7zw_byte(b, Z7_T_UnPackSize);
+		FFSLICE_WALK(&w->folders, fo) {
+			_ff7zw_int(b, fo->unpack_size);
+		}
+		_ff7zw_byte(b, Z7_T_End);
+
+		// CRC of each file is in SubStreamsInfo, so folder CRC isn't written
+		_ff7zw_byte(b, Z7_T_SubStreamsInfo);
+		_ff7zw_byte(b, Z7_T_NumUnPackStream);
+		FFSLICE_WALK(&w->folders, fo) {
+			_ff7zw_int(b, fo->files);
+		}
+
+		_ff7zw_byte(b, Z7_T_Size);
+		f = files;
+		FFSLICE_WALK(&w->folders, fo) {
+			for (ffuint64 i = 0;  i != fo->files;  f++) {
+				if (f->size == 0)
+					continue;
+				if (i + 1 != fo->files)
+					_ff7zw_int(b, f->size);
+				i++;
+			}
+		}
+
+		_ff7zw_byte(b, Z7_T_CRC);
+		_ff7zw_byte(b, 1); // AllAreDefined
+		FFSLICE_WALK(&w->files, f) {
+			if (f->size != 0)
+				_ff7zw_int32(b, f->crc);
+		}
+		_ff7zw_byte(b, Z7_T_End);
+
+		_ff7zw_byte(b, Z7_T_End);
+	}
+
+	if (w->files.len != 0) {
+		ffsize off, nempty = 0;
+		_ff7zw_byte(b, Z7_T_FilesInfo);
+		_ff7zw_int(b, w->files.len);
+
+		FFSLICE_WALK(&w->files, f) {
+			if (f->size == 0)
+				nempty++;
+		}
+
+		if (nempty != 0) {
+			off = _ff7zw_prop_begin(b, Z7_T_EmptyStream);
+			if (NULL == ffvec_growT(b, (w->files.len + 7) / 8, char))
+				return -1;
+			ffmem_zero(ffslice_endT(b, char), (w->files.len + 7) / 8);
+			ffsize i = 0;
+			FFSLICE_WALK(&w->files, f) {
+				if (f->size == 0)
+					ffbit_array_set(ffslice_endT(b, char), i);
+				i++;
+			}
+			b->len += (w->files.len + 7) / 8;
+			_ff7zw_prop_end(b, off);
+
+			off = _ff7zw_prop_begin(b, Z7_T_EmptyFile);
+			if (NULL == ffvec_growT(b, (nempty + 7) / 8, char))
+				return -1;
+			ffmem_zero(ffslice_endT(b, char), (nempty + 7) / 8);
+			i = 0;
+			FFSLICE_WALK(&w->files, f) {
+				if (f->size != 0)
+					continue;
+				if (!(f->attr & 0x10))
+					ffbit_array_set(ffslice_endT(b, char), i);
+				i++;
+			}
+			b->len += (nempty + 7) / 8;
+			_ff7zw_prop_end(b, off);
+		}
+
+		off = _ff7zw_prop_begin(b, Z7_T_Name);
+		_ff7zw_byte(b, 0); // External
+		FFSLICE_WALK(&w->files, f) {
+			ffssize n = ffutf8_to_utf16(NULL, 0, f->name.ptr, f->name.len, FFUNICODE_UTF16LE);
+			if (n < 0 || NULL == ffvec_growT(b, n + 2, char))
+				return -1;
+			b->len += ffutf8_to_utf16(ffslice_endT(b, char), n, f->name.ptr, f->name.len, FFUNICODE_UTF16LE);
+			_ff7zw_byte(b, 0);
+			_ff7zw_byte(b, 0);
+		}
+		_ff7zw_prop_end(b, off);
+
+		off = _ff7zw_prop_begin(b, Z7_T_MTime);
+		_ff7zw_byte(b, 1); // AllAreDefined
+		_ff7zw_byte(b, 0); // External
+		FFSLICE_WALK(&w->files, f) {
+			z7_fftime_winftime ft = z7_fftime_to_winftime(&f->mtime);
+			_ff7zw_int32(b, ft.lo);
+			_ff7zw_int32(b, ft.hi);
+		}
+		_ff7zw_prop_end(b, off);
+
+		off = _ff7zw_prop_begin(b, Z7_T_WinAttributes);
+		_ff7zw_byte(b, 1); // AllAreDefined
+		_ff7zw_byte(b, 0); // External
+		FFSLICE_WALK(&w->files, f) {
+			_ff7zw_int32(b, f->attr);
+		}
+		_ff7zw_prop_end(b, off);
+
+		_ff7zw_byte(b, Z7_T_End);
+	}
+
+	_ff7zw_byte(b, Z7_T_End);
+	return 0;
+}
+
+/** Build the descriptor of the packed header */
+static inline void _ff7zw_hdr_enc_write(ffvec *b, ffuint64 off, const struct _ff7zw_folder *fo, ffuint crc)
+{
+	_ff7zw_byte(b, Z7_T_EncodedHeader);
+
+	_ff7zw_byte(b, Z7_T_PackInfo);
+	_ff7zw_int(b, off - sizeof(struct z7_ghdr));
+	_ff7zw_int(b, 1);
+	_ff7zw_byte(b, Z7_T_Size);
+	_ff7zw_int(b, fo->pack_size);
+	_ff7zw_byte(b, Z7_T_End);
+
+	_ff7zw_byte(b, Z7_T_UnPackInfo);
+	_ff7zw_byte(b, Z7_T_Folder);
+	_ff7zw_int(b, 1);
+	_ff7zw_byte(b, 0); // External
+	_ff7zw_folder_write(b, fo);
+	_ff7zw_byte(b, Z7_T_UnPackSize);
+	_ff7zw_int(b, fo->unpack_size);
+	_ff7zw_byte(b, Z7_T_CRC);
+	_ff7zw_byte(b, 1); // AllAreDefined
+	_ff7zw_int32(b, crc);
+	_ff7zw_byte(b, Z7_T_End);
+
+	_ff7zw_byte(b, Z7_T_End);
+}
+
+/** Does the file with data need a new folder? */
+static inline int _ff7zw_folder_next(ff7zwrite *w)
+{
+	const struct _ff7zw_file *f = ffslice_lastT(&w->files, struct _ff7zw_file);
+	if (w->solid_size != 0 && w->folder.unpack_size >= w->solid_size)
+		return 1;
+	if (w->solid_ext) {
+		ffstr ext = _ff7zw_ext(f->name);
+		if (!ffstr_ieq2(&ext, &w->folder.ext))
+			return 1;
+	}
+	return 0;
+}
+
+/* .7z write:
+. write signature header placeholder
+. for each new file with data:
+ . start a new folder if needed (the previous folder's encoder is flushed)
+ . pass file data through folder encoder
+. write the remaining data of the last folder
+. compress header;  write packed header and its descriptor
+. seek to the beginning;  write signature header
+*/
+static inline int ff7zwrite_process(ff7zwrite *w, ffstr *input, ffstr *output)
+{
+	int r;
+	enum {
+		W_START = 0, W_FILE, W_DATA, W_FDONE, W_FOLDER_FIN, W_BLOCK, W_BLOCK_DONE,
+		W_HDR, W_HDR_ENC, W_SIG_SEEK, W_SIG, W_DONE,
+	};
+
+	for (;;) {
+		switch (w->state) {
+
+		case W_START:
+			if (NULL == ffvec_allocT(&w->buf, _FF7ZWRITE_BUFCAP, char)) {
+				w->error = "no memory";
+				return FF7ZWRITE_ERROR;
+			}
+			ffmem_zero(w->buf.ptr, sizeof(struct z7_ghdr));
+			ffstr_set(output, w->buf.ptr, sizeof(struct z7_ghdr));
+			w->total_wr = sizeof(struct z7_ghdr);
+			w->state = W_FILE;
+			return FF7ZWRITE_DATA; // signature header placeholder
+
+		case W_FILE:
+			if (w->block != NULL) {
+				w->state = W_BLOCK;
+				if (w->folder_open) {
+					w->next_state = W_BLOCK;
+					w->state = W_FOLDER_FIN;
+				}
+				continue;
+			}
+			if (w->arc_fin) {
+				w->state = W_HDR;
+				if (w->folder_open) {
+					w->next_state = W_HDR;
+					w->state = W_FOLDER_FIN;
+				}
+				continue;
+			}
+			if (!w->file_added) {
+				w->error = "file info isn't ready";
+				return FF7ZWRITE_ERROR;
+			}
+			w->file_size = 0;
+			w->file_crc = 0;
+			w->state = W_DATA;
+			continue;
+
+		case W_DATA: {
+			if (input->len == 0) {
+				if (!w->file_fin)
+					return FF7ZWRITE_MORE;
+				w->state = W_FDONE;
+				continue;
+			}
+
+			if (w->file_size == 0) {
+				struct _ff7zw_file *f = ffslice_lastT(&w->files, struct _ff7zw_file);
+				if (f->attr & 0x10) {
+					w->error = "directory can't have data";
+					return FF7ZWRITE_ERROR;
+				}
+
+				if (w->folder_open && _ff7zw_folder_next(w)) {
+					w->next_state = W_DATA;
+					w->state = W_FOLDER_FIN;
+					continue;
+				}
+
+				if (!w->folder_open) {
+					ffmem_zero_obj(&w->folder);
+					w->folder.method = (w->coder.method != 0) ? w->coder.method : Z7_M_LZMA2;
+					if (w->folder.method != Z7_M_STORE) {
+						if (0 > (r = _ff7zw_coder_open(&w->coder_cur, &w->coder, w->folder.method, w->folder.props))) {
+							w->error = "folder encoder init";
+							return FF7ZWRITE_ERROR;
+						}
+						w->folder.nprops = r;
+					}
+					ffstr ext = _ff7zw_ext(f->name);
+					if (NULL == ffstr_dup2(&w->folder.ext, &ext)) {
+						w->error = "no memory";
+						return FF7ZWRITE_ERROR;
+					}
+					w->folder_open = 1;
+				}
+			}
+
+			ffstr in = *input;
+			if (w->folder.method == Z7_M_STORE) {
+				*output = *input;
+				r = input->len;
+				ffstr_shift(&in, r);
+			} else {
+				r = _ff7zw_coder_process(&w->coder_cur, &in, (char*)w->buf.ptr, w->buf.cap, 0);
+				if (r < 0) {
+					w->error = "folder encoder";
+					return FF7ZWRITE_ERROR;
+				}
+				ffstr_set(output, w->buf.ptr, r);
+			}
+
+			ffsize n = input->len - in.len;
+			w->file_crc = crc32((void*)input->ptr, n, w->file_crc);
+			w->file_size += n;
+			w->folder.unpack_size += n;
+			*input = in;
+			if (r == 0)
+				continue;
+			w->folder.pack_size += r;
+			w->total_wr += r;
+			return FF7ZWRITE_DATA; // file data
+		}
+
+		case W_FDONE: {
+			struct _ff7zw_file *f = ffslice_lastT(&w->files, struct _ff7zw_file);
+			f->size = w->file_size;
+			f->crc = w->file_crc;
+			if (f->size != 0)
+				w->folder.files++;
+			w->file_added = 0;
+			w->file_fin = 0;
+			w->state = W_FILE;
+			return FF7ZWRITE_FILEDONE;
+		}
+
+		case W_FOLDER_FIN:
+			if (w->folder.method != Z7_M_STORE) {
+				ffstr in = {};
+				r = _ff7zw_coder_process(&w->coder_cur, &in, (char*)w->buf.ptr, w->buf.cap, 1);
+				if (r < 0) {
+					w->error = "folder encoder";
+					return FF7ZWRITE_ERROR;
+				}
+				if (r != 0) {
+					ffstr_set(output, w->buf.ptr, r);
+					w->folder.pack_size += r;
+					w->total_wr += r;
+					return FF7ZWRITE_DATA; // the rest of folder data
+				}
+				_ff7zw_coder_close(&w->coder_cur);
+			}
+
+			if (NULL == ffvec_pushT(&w->folders, struct _ff7zw_folder)) {
+				w->error = "no memory";
+				return FF7ZWRITE_ERROR;
+			}
+			*ffslice_lastT(&w->folders, struct _ff7zw_folder) = w->folder;
+			ffmem_zero_obj(&w->folder);
+			w->folder_open = 0;
+			w->state = w->next_state;
+			continue;
+
+		case W_BLOCK: {
+			ff7zwrite_block *blk = w->block;
+			w->state = W_BLOCK_DONE;
+			if (blk->unpack_size == 0)
+				continue;
+
+			struct _ff7zw_folder *fo;
+			if (NULL == (fo = ffvec_zpushT(&w->folders, struct _ff7zw_folder))) {
+				w->error = "no memory";
+				return FF7ZWRITE_ERROR;
+			}
+			fo->method = blk->method;
+			fo->nprops = blk->nprops;
+			ffmem_copy(fo->props, blk->props, sizeof(fo->props));
+			fo->pack_size = blk->data.len;
+			fo->unpack_size = blk->unpack_size;
+			const ffuint64 *sz;
+			FFSLICE_WALK(&blk->sizes, sz) {
+				if (*sz != 0)
+					fo->files++;
+			}
+
+			ffstr_set2(output, &blk->data);
+			w->total_wr += blk->data.len;
+			return FF7ZWRITE_DATA; // block data
+		}
+
+		case W_BLOCK_DONE:
+			w->block = NULL;
+			w->state = W_FILE;
+			return FF7ZWRITE_FILEDONE;
+
+		case W_HDR: {
+			ffvec hdr = {};
+			struct _ff7zw_folder fo = {};
+			ff7zwrite_coder_conf conf = {};
+			ffstr d;
+			if (0 != _ff7zw_hdr_write(w, &hdr))
+				goto hdr_err;
+			fo.method = Z7_M_LZMA2;
+			fo.unpack_size = hdr.len;
+			ffstr_set2(&d, &hdr);
+			w->buf.len = 0;
+			if (0 != _ff7zw_compress(&conf, Z7_M_LZMA2, &d, 1, &w->buf, fo.props, &fo.nprops))
+				goto hdr_err;
+			fo.pack_size = w->buf.len;
+			ffuint crc = crc32(hdr.ptr, hdr.len, 0);
+
+			// the descriptor follows the packed header
+			hdr.len = 0;
+			_ff7zw_hdr_enc_write(&hdr, w->total_wr, &fo, crc);
+			w->info.hdr_off = w->total_wr + fo.pack_size;
+			w->info.hdr_size = hdr.len;
+			w->info.hdr_crc = crc32(hdr.ptr, hdr.len, 0);
+			if (hdr.len != ffvec_add2T(&w->buf, &hdr, char))
+				goto hdr_err;
+			ffvec_free(&hdr);
+			w->state = W_HDR_ENC;
+			continue;
+
+hdr_err:
+			ffvec_free(&hdr);
+			w->error = "header write";
+			return FF7ZWRITE_ERROR;
+		}
+
+		case W_HDR_ENC:
+			ffstr_set2(output, &w->buf);
+			w->total_wr += w->buf.len;
+			w->state = W_SIG_SEEK;
+			return FF7ZWRITE_DATA; // packed header and its descriptor
+
+		case W_SIG_SEEK:
+			w->offset = 0;
+			w->state = W_SIG;
+			return FF7ZWRITE_SEEK; // seek to signature header
+
+		case W_SIG:
+			if (NULL == ffvec_reallocT(&w->buf, sizeof(struct z7_ghdr), char)) {
+				w->error = "no memory";
+				return FF7ZWRITE_ERROR;
+			}
+			z7_ghdr_write((char*)w->buf.ptr, &w->info);
+			ffstr_set(output, w->buf.ptr, sizeof(struct z7_ghdr));
+			w->offset = w->total_wr;
+			w->state = W_DONE;
+			return FF7ZWRITE_DATA; // signature header
+
+		case W_DONE:
+			return FF7ZWRITE_DONE;
+
+		default:
+			FF_ASSERT(0);
+			return FF7ZWRITE_ERROR;
+		}
+	}
+}
@@ -4,7 +4,9 @@
 
 /*
 z7_ghdr_read
+z7_ghdr_write
 z7_varint
+z7_varint_write
 z7_find_block
 z7_check_req
 */
@@ -61,6 +63,7 @@ enum Z7_E {
 	Z7_EDATACRC,
 	Z7_ELZMA,
 	Z7_EZLIB,
+	Z7_EZSTD,
 };
 
 enum Z7_METHOD {
@@ -70,6 +73,7 @@ enum Z7_METHOD {
 	Z7_M_X86,
 	Z7_M_X86_BCJ2,
 	Z7_M_DEFLATE,
+	Z7_M_ZSTD,
 	Z7_M_LZMA2,
 };
 
@@ -121,6 +125,7 @@ enum Z7_F {
 	Z7_F_SIZE = 0x0800, // read block size (varint) before block body
 	Z7_F_SELF = 0x1000,
 	Z7_F_MULTI = 0x2000, // allow multiple occurrences
+	Z7_F_OPT = 0x4000, // block with priority may be absent: the block with the next priority may follow
 };
 
 #define Z7_PRIO(n)  (n) << 24
@@ -147,8 +152,10 @@ struct z7_coder {
 	ffuint method;
 	ffuint nprops;
 	ffbyte props[8];
-	struct z7_stream stream;
-	ffbyte input_coders[Z7_MAX_CODERS];
+	ffuint inputs; // number of input streams
+	struct z7_stream stream; // packed stream for input #0
+	struct z7_stream streams[Z7_MAX_CODERS - 1]; // packed streams for inputs #1..
+	ffbyte input_coders[Z7_MAX_CODERS]; // 1-based index of the coder whose output is bound to input #i
 	ffuint64 unpack_size;
 };
 
@@ -161,6 +168,10 @@ struct z7_folder {
 	ffuint64 unpack_size;
 
 	ffvec empty; // bit-array of total files in archive. Valid for the last stream that contains empty files.
+
+	/* Valid for the first folder: */
+	ffvec file_arena; // z7_fileinfo[] for the files of all folders ('files' of each folder points here)
+	ffvec name_arena; // char[]: names of all files ('name' of each file points here)
 };
 
 struct z7_ghdr {
@@ -199,6 +210,22 @@ static inline int z7_ghdr_read(struct z7_info *info, const char *data)
 	return 0;
 }
 
+/** Write global header
+info: 'hdr_off' is the absolute header offset, as z7_ghdr_read() returns */
+static inline void z7_ghdr_write(char *data, const struct z7_info *info)
+{
+	struct z7_ghdr *h = (struct z7_ghdr*)data;
+	static const ffbyte hdr_signature[] = {'7', 'z', 0xbc, 0xaf, 0x27, 0x1c};
+	ffmem_copy(h->sig, hdr_signature, 6);
+	h->ver_major = 0;
+	h->unused = 4;
+	*(ffuint64*)h->hdr_off = ffint_le_cpu64(info->hdr_off - sizeof(struct z7_ghdr));
+	*(ffuint64*)h->hdr_size = ffint_le_cpu64(info->hdr_size);
+	*(ffuint*)h->hdr_crc = ffint_le_cpu32(info->hdr_crc);
+	ffuint crc = crc32((void*)h->hdr_off, sizeof(struct z7_ghdr) - FF_OFF(struct z7_ghdr, hdr_off), 0);
+	*(ffuint*)h->crc = ffint_le_cpu32(crc);
+}
+
 /** Read varint */
 /*
 HI1 [LO8..HI2] -> LO8..HI1 (LE) -> host int
@@ -230,6 +257,25 @@ static inline int z7_varint(const char *data, ffsize len, ffuint64 *val)
 	return size;
 }
 
+/** Write varint
+dst: at least 9 bytes
+Return N of bytes written */
+static inline ffuint z7_varint_write(char *dst, ffuint64 val)
+{
+	ffuint n;
+	for (n = 0;  n != 8;  n++) {
+		if (val < (1ULL << (7 * (n + 1))))
+			break;
+	}
+
+	ffbyte hi_mask = (ffbyte)(0xff00 >> n); // N of extra bytes as the high bits set
+	dst[0] = (n == 8) ? (char)0xff : (char)(hi_mask | (val >> (8 * n)));
+	for (ffuint i = 0;  i != n;  i++) {
+		dst[1 + i] = (char)(val >> (8 * i));
+	}
+	return n + 1;
+}
+
 /** Read byte and shift input */
 static int z7_readbyte(ffstr *d, ffuint *val)
 {
@@ -273,8 +319,17 @@ static inline int z7_find_block(ffuint blk_id, const struct z7_binblock **pblock
 
 	ffuint prio = Z7_GET_PRIO(blk->flags);
 	if (prio != 0) {
-		if (prio > parent->prio + 1)
-			return Z7_EORDER;
+		if (prio > parent->prio + 1) {
+			// allow skipping only the optional blocks
+			for (ffuint k = 0;  ;  k++) {
+				ffuint f = parent->children[k].flags;
+				ffuint p = Z7_GET_PRIO(f);
+				if (p > parent->prio && p < prio && !(f & Z7_F_OPT))
+					return Z7_EORDER;
+				if (f & Z7_F_LAST)
+					break;
+			}
+		}
 		parent->prio = prio;
 	}
 
@@ -363,6 +418,7 @@ static const char z7_method[][4] = {
 	{0x03,0x03,0x01,0x03}, // Z7_M_X86
 	{0x03,0x03,0x01,0x1b}, // Z7_M_X86_BCJ2
 	{0x04,0x01,0x08}, // Z7_M_DEFLATE
+	{0x04,(char)0xf7,0x11,0x01}, // Z7_M_ZSTD
 	{0x21}, // Z7_M_LZMA2
 };
 
@@ -375,11 +431,12 @@ static int z7_folder_read(struct z7_folder *fo, ffstr *d, ffslice *stms)
 	if (0 == z7_readint(d, &coders_n))
 		return Z7_EMORE;
 	_ff7zread_log(_ff7z_log_param, 0, " coders:%U", coders_n);
-	if (coders_n - 1 > Z7_MAX_CODERS)
+	if (coders_n - 1 >= Z7_MAX_CODERS)
 		return Z7_EDATA;
 
-	in_streams = coders_n;
+	in_streams = 0;
 	fo->coders = coders_n;
+	ffbyte in_coder[Z7_MAX_CODERS * Z7_MAX_CODERS], in_index[Z7_MAX_CODERS * Z7_MAX_CODERS];
 
 	for (ffuint i = 0;  i != coders_n;  i++) {
 
@@ -405,10 +462,18 @@ static int z7_folder_read(struct z7_folder *fo, ffstr *d, ffslice *stms)
 			if (0 == z7_readint(d, &n))
 				return Z7_EMORE;
 			_ff7zread_log(_ff7z_log_param, 0, "   complex-coder: in:%U  out:%U", in, n);
-			if (in - 1 > Z7_MAX_CODERS || n != 1)
+			if (in - 1 >= Z7_MAX_CODERS || n != 1)
 				return Z7_EDATA;
 			flags &= ~FOLDER_F_COMPLEXCODER;
-			in_streams += in - 1;
+			cod->inputs = in;
+		} else {
+			cod->inputs = 1;
+		}
+
+		for (ffuint k = 0;  k != cod->inputs;  k++) {
+			in_coder[in_streams] = i;
+			in_index[in_streams] = k;
+			in_streams++;
 		}
 
 		if (flags & FOLDER_F_ATTRS) {
@@ -429,7 +494,9 @@ static int z7_folder_read(struct z7_folder *fo, ffstr *d, ffslice *stms)
 			return Z7_EFOLDER_FLAGS;
 	}
 
+	// each coder has 1 output stream, so output stream index == coder index
 	ffuint bonds = coders_n - 1;
+	ffuint bound = 0; // bit-array of input streams bound to coder outputs
 	for (ffuint i = 0;  i != bonds;  i++) {
 		ffuint64 in, out;
 		if (0 == z7_readint(d, &in))
@@ -437,24 +504,43 @@ static int z7_folder_read(struct z7_folder *fo, ffstr *d, ffslice *stms)
 		if (0 == z7_readint(d, &out))
 			return Z7_EMORE;
 		_ff7zread_log(_ff7z_log_param, 0, "  bond: in:%U  out:%U", in, out);
-		fo->coder[coders_n - 1].input_coders[i] = i + 1;
+		if (in >= in_streams || out >= coders_n || (bound & (1U << in)))
+			return Z7_EDATA;
+		bound |= 1U << in;
+		fo->coder[in_coder[in]].input_coders[in_index[in]] = out + 1;
 	}
 
 	ffuint pack_streams = in_streams - bonds;
 	if (pack_streams > stms->len)
 		return Z7_EDATA;
-	if (pack_streams != 1) {
+	ffbyte pack_in[Z7_MAX_CODERS * Z7_MAX_CODERS];
+	if (pack_streams == 1) {
+		for (ffuint i = 0;  i != in_streams;  i++) {
+			if (!(bound & (1U << i))) {
+				pack_in[0] = i;
+				break;
+			}
+		}
+	} else {
 		for (ffuint i = 0;  i != pack_streams;  i++) {
 			if (0 == z7_readint(d, &n))
 				return Z7_EMORE;
 			_ff7zread_log(_ff7z_log_param, 0, "  pack-stream:%U", n);
+			if (n >= in_streams || (bound & (1U << n)))
+				return Z7_EDATA;
+			bound |= 1U << n;
+			pack_in[i] = n;
 		}
 	}
 
 	struct z7_stream *stm = (struct z7_stream*)stms->ptr;
 	for (ffuint i = 0;  i != pack_streams;  i++) {
-		fo->coder[i].stream.off = stm->off;
-		fo->coder[i].stream.pack_size = stm->pack_size;
+		struct z7_coder *cod = &fo->coder[in_coder[pack_in[i]]];
+		ffuint k = in_index[pack_in[i]];
+		if (k == 0)
+			cod->stream = *stm;
+		else
+			cod->streams[k - 1] = *stm;
 		stm++;
 	}
 	ffslice_set(stms, stm, stms->len - pack_streams);
@@ -580,26 +666,35 @@ static int z7_datacrcs_read(ffvec *folders, ffstr *d)
 	return 0;
 }
 
-/*
+/** File records of all folders are allocated as one array
+
 varint NumUnPackStreamsInFolders[folders]
 */
 static int z7_stmfiles_read(ffvec *folders, ffstr *d)
 {
-	int r;
-	ffuint64 n;
+	ffuint64 n, total = 0;
 	struct z7_folder *fo = (struct z7_folder*)folders->ptr;
+	if (folders->len == 0)
+		return 0;
 
+	ffstr d2 = *d;
 	for (ffsize i = 0;  i != folders->len;  i++) {
-
-		if (0 == (r = z7_readint(d, &n)))
+		if (0 == z7_readint(&d2, &n))
 			return Z7_EMORE;
-		_ff7zread_log(_ff7z_log_param, 0, " folder#%L  files:%U", i, n);
-		if (n == 0)
+		if (n == 0 || n > d->len * 8 /*sanity check*/)
 			return Z7_EDATA;
+		total += n;
+	}
 
-		if (NULL == ffvec_zallocT(&fo[i].files, n, struct z7_fileinfo))
-			return Z7_ESYS;
-		fo[i].files.len = n;
+	if (NULL == ffvec_zallocT(&fo[0].file_arena, total, struct z7_fileinfo))
+		return Z7_ESYS;
+	struct z7_fileinfo *f = (struct z7_fileinfo*)fo[0].file_arena.ptr;
+
+	for (ffsize i = 0;  i != folders->len;  i++) {
+		z7_readint(d, &n);
+		_ff7zread_log(_ff7z_log_param, 0, " folder#%L  files:%U", i, n);
+		ffvec_set(&fo[i].files, f, n);
+		f += n;
 	}
 
 	return 0;
@@ -711,7 +806,9 @@ static int z7_fileinfo_read(ffvec *folders, ffstr *d)
 
 	if (n > all) {
 		// add one more stream with empty files and directory entries
-		fo = ffvec_pushT(folders, struct z7_folder);
+		if (NULL == (fo = ffvec_pushT(folders, struct z7_folder)))
+			return Z7_ESYS;
+		ffmem_zero_obj(fo); // not preallocated if there was no MainStreamsInfo
 		if (NULL == ffvec_zallocT(&fo->files, n - all, struct z7_fileinfo))
 			return Z7_ESYS;
 		fo->files.len = n - all;
@@ -776,6 +873,7 @@ static int z7_dummy_read(ffvec *folders, ffstr *d)
 }
 
 /** Read filenames.  Put names of empty files into the last stream.
+All names are stored in one memory region.
 
 byte External
 {
@@ -793,6 +891,13 @@ static int z7_names_read(ffvec *folders, ffstr *d)
 		return Z7_EMORE;
 	if (!!ext)
 		return Z7_EUNSUPP;
+	if (folders->len == 0)
+		return Z7_EDATA;
+
+	// UTF-16 -> UTF-8: 3 bytes max. per 2 bytes
+	ffvec *arena = &((struct z7_folder*)folders->ptr)->name_arena;
+	if (NULL == ffvec_allocT(arena, d->len / 2 * 3 + 1, char))
+		return Z7_ESYS;
 
 	struct z7_folder *fo_empty = ffslice_lastT(folders, struct z7_folder);
 	struct z7_fileinfo *fem = (struct z7_fileinfo*)fo_empty->files.ptr;
@@ -816,25 +921,25 @@ static int z7_names_read(ffvec *folders, ffstr *d)
 				return Z7_EMORE;
 			n += 2;
 
-			ffvec a = {};
-			if (NULL == ffvec_alloc(&a, n * 3, 1))
-				return Z7_ESYS;
-
-			if (0 == (r = ffutf8_from_utf16((char*)a.ptr, a.cap, d->ptr, n, FFUNICODE_UTF16LE))) {
-				ffvec_free(&a);
+			char *p = ffslice_endT(arena, char);
+			if (0 == (r = ffutf8_from_utf16(p, ffvec_unused(arena), d->ptr, n, FFUNICODE_UTF16LE)))
 				return Z7_EDATA;
-			}
 			ffstr_shift(d, n);
 			_ff7zread_log(_ff7z_log_param, 0, " folder#%L name[%L](%L):%*s"
-				, ifo, i, cnt, (ffsize)r - 1, a.ptr);
-			a.len = _ffpack_path_normalize((char*)a.ptr, a.cap, (char*)a.ptr, r - 1, _FFPACK_PATH_FORCE_SLASH | _FFPACK_PATH_SIMPLE);
-			((char*)a.ptr)[a.len] = '\0';
+				, ifo, i, cnt, (ffsize)r - 1, p);
+			ffstr name;
+			name.len = _ffpack_path_normalize(p, ffvec_unused(arena), p, r - 1, _FFPACK_PATH_FORCE_SLASH | _FFPACK_PATH_SIMPLE);
+			if (name.len >= ffvec_unused(arena))
+				return Z7_EDATA;
+			p[name.len] = '\0';
+			name.ptr = p;
+			arena->len += name.len + 1;
 
 			if (fo_empty != NULL && ffbit_array_test(fo_empty->empty.ptr, cnt)) {
-				ffstr_set2(&fem[ifem].name, &a);
+				fem[ifem].name = name;
 				ifem++;
 			} else {
-				ffstr_set2(&f[i].name, &a);
+				f[i].name = name;
 				i++;
 			}
 			cnt++;
@@ -862,6 +967,19 @@ static inline fftime z7_fftime_from_winftime(const z7_fftime_winftime *ft)
 	return t;
 }
 
+/** fftime -> Windows FILETIME */
+static inline z7_fftime_winftime z7_fftime_to_winftime(const fftime *t)
+{
+	z7_fftime_winftime ft = {};
+	const ffuint64 tm100ns = 116444736000000000ULL; // 100-ns intervals within 1600..1970
+	if (t->sec >= 0) {
+		ffuint64 i = (ffuint64)t->sec * 1000000 * 10 + t->nsec / 100 + tm100ns;
+		ft.lo = (ffuint)i;
+		ft.hi = (ffuint)(i >> 32);
+	}
+	return ft;
+}
+
 /*
 byte AllAreDefined
  0:
@@ -1029,7 +1147,7 @@ static const struct z7_binblock z7_ctx_top[] = {
 
 static const struct z7_binblock z7_hdr_ctx[] = {
 	{ Z7_T_AdditionalStreamsInfo | Z7_F_CHILDREN,	z7_stminfo_ctx },
-	{ Z7_T_MainStreamsInfo | Z7_F_REQ | Z7_F_CHILDREN | Z7_PRIO(1),	z7_stminfo_ctx },
+	{ Z7_T_MainStreamsInfo | Z7_F_OPT | Z7_F_CHILDREN | Z7_PRIO(1),	z7_stminfo_ctx }, // absent if there's no file data
 	{ Z7_T_FilesInfo | Z7_F_CHILDREN | Z7_PRIO(2),	z7_fileinfo_ctx },
 	{ Z7_T_End | Z7_F_LAST,	NULL },
 };
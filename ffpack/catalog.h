@@ -0,0 +1,367 @@
+/** ffpack: archive catalog
+* file meta data for the whole archive in parallel arrays (struct-of-arrays)
+* file names are packed into one string arena
+* binary serialization which can be used directly from mapped memory
+2026 */
+
+/*
+ffpack_catalog_free
+ffpack_catalog_add
+ffpack_catalog_get
+ffpack_catalog_name
+ffpack_catalog_find
+ffpack_catalog_order_size
+ffpack_catalog_save
+ffpack_catalog_load
+ffpack_fnv1a64
+*/
+
+#pragma once
+
+#include <ffbase/vector.h>
+#include <ffbase/string.h>
+#include <ffbase/sort.h>
+
+typedef struct ffpack_catalog {
+	ffsize len; // number of entries
+	ffvec hdr_offset; // ffuint64[]: offset of the entry's header within archive
+	ffvec comp_size; // ffuint64[]: compressed (on-disk) size
+	ffvec size; // ffuint64[]: uncompressed size
+	ffvec crc; // ffuint[]: CRC32 of uncompressed data
+	ffvec method; // ffushort[]: format-specific compression method
+	ffvec mtime; // ffint64[]: seconds since 1970
+	ffvec attr; // ffuint[]: (UNIX attributes << 16) | Windows attributes
+	ffvec name_off; // ffuint[]: offset of the entry's name in 'names'
+	ffvec names; // char[]: "name\0name\0..."
+	ffvec name_hash; // ffuint[]: FNV-1a hash of the entry's name.  Set by ffpack_catalog_load().
+	ffuint64 meta_hash; // hash of the archive meta data from which the catalog was built (e.g. zip CDIR)
+	ffuint64 data_end; // offset where the area of entries' data ends (e.g. zip CDIR offset)
+} ffpack_catalog;
+
+typedef struct ffpack_catalog_ent {
+	ffstr name;
+	ffuint64 hdr_offset;
+	ffuint64 comp_size, size;
+	ffuint crc;
+	ffuint method;
+	ffint64 mtime;
+	ffuint attr;
+} ffpack_catalog_ent;
+
+static inline void ffpack_catalog_free(ffpack_catalog *c)
+{
+	ffvec_free(&c->hdr_offset);
+	ffvec_free(&c->comp_size);
+	ffvec_free(&c->size);
+	ffvec_free(&c->crc);
+	ffvec_free(&c->method);
+	ffvec_free(&c->mtime);
+	ffvec_free(&c->attr);
+	ffvec_free(&c->name_off);
+	ffvec_free(&c->names);
+	ffvec_free(&c->name_hash);
+	c->len = 0;
+}
+
+/** Reserve space for the next entry in all arrays
+Return entry index
+  <0 on error */
+static inline ffssize _ffpack_catalog_push(ffpack_catalog *c)
+{
+	if (NULL == ffvec_growtwiceT(&c->hdr_offset, 1, ffuint64)
+		|| NULL == ffvec_growtwiceT(&c->comp_size, 1, ffuint64)
+		|| NULL == ffvec_growtwiceT(&c->size, 1, ffuint64)
+		|| NULL == ffvec_growtwiceT(&c->crc, 1, ffuint)
+		|| NULL == ffvec_growtwiceT(&c->method, 1, ffushort)
+		|| NULL == ffvec_growtwiceT(&c->mtime, 1, ffint64)
+		|| NULL == ffvec_growtwiceT(&c->attr, 1, ffuint)
+		|| NULL == ffvec_growtwiceT(&c->name_off, 1, ffuint))
+		return -1;
+
+	ffsize i = c->len++;
+	c->hdr_offset.len = c->comp_size.len = c->size.len = c->crc.len = c->method.len
+		= c->mtime.len = c->attr.len = c->name_off.len = c->len;
+	return i;
+}
+
+/** Add entry
+Return entry index
+  <0 on error */
+static inline ffssize ffpack_catalog_add(ffpack_catalog *c, const ffpack_catalog_ent *e)
+{
+	if (c->names.len + e->name.len + 1 > 0xffffffff)
+		return -1;
+	if (NULL == ffvec_growtwiceT(&c->names, e->name.len + 1, char))
+		return -1;
+
+	ffssize i = _ffpack_catalog_push(c);
+	if (i < 0)
+		return -1;
+
+	((ffuint64*)c->hdr_offset.ptr)[i] = e->hdr_offset;
+	((ffuint64*)c->comp_size.ptr)[i] = e->comp_size;
+	((ffuint64*)c->size.ptr)[i] = e->size;
+	((ffuint*)c->crc.ptr)[i] = e->crc;
+	((ffushort*)c->method.ptr)[i] = e->method;
+	((ffint64*)c->mtime.ptr)[i] = e->mtime;
+	((ffuint*)c->attr.ptr)[i] = e->attr;
+	((ffuint*)c->name_off.ptr)[i] = c->names.len;
+
+	char *p = ffslice_endT(&c->names, char);
+	ffmem_copy(p, e->name.ptr, e->name.len);
+	p[e->name.len] = '\0';
+	c->names.len += e->name.len + 1;
+	return i;
+}
+
+/** Get entry's name (NULL-terminated) */
+static inline ffstr ffpack_catalog_name(const ffpack_catalog *c, ffsize i)
+{
+	const ffuint *name_off = (ffuint*)c->name_off.ptr;
+	ffsize end = (i + 1 != c->len) ? name_off[i + 1] : c->names.len;
+	ffstr s;
+	ffstr_set(&s, (char*)c->names.ptr + name_off[i], end - name_off[i] - 1);
+	return s;
+}
+
+/** Get entry
+e.name: points to the catalog's arena */
+static inline void ffpack_catalog_get(const ffpack_catalog *c, ffsize i, ffpack_catalog_ent *e)
+{
+	e->name = ffpack_catalog_name(c, i);
+	e->hdr_offset = ((ffuint64*)c->hdr_offset.ptr)[i];
+	e->comp_size = ((ffuint64*)c->comp_size.ptr)[i];
+	e->size = ((ffuint64*)c->size.ptr)[i];
+	e->crc = ((ffuint*)c->crc.ptr)[i];
+	e->method = ((ffushort*)c->method.ptr)[i];
+	e->mtime = ((ffint64*)c->mtime.ptr)[i];
+	e->attr = ((ffuint*)c->attr.ptr)[i];
+}
+
+static int _ffpack_catalog_size_cmp(const void *a, const void *b, void *udata)
+{
+	const ffuint64 *comp_size = (ffuint64*)udata;
+	ffuint64 sa = comp_size[*(ffuint*)a], sb = comp_size[*(ffuint*)b];
+	if (sa != sb)
+		return (sa < sb) ? 1 : -1;
+	return (*(ffuint*)a < *(ffuint*)b) ? -1 : 1;
+}
+
+/** Get the order in which entries should be processed by parallel workers:
+ the largest (by compressed size) first, so the small ones fill the gaps at the end.
+idx: (output) array of c->len entry indexes */
+static inline void ffpack_catalog_order_size(const ffpack_catalog *c, ffuint *idx)
+{
+	for (ffsize i = 0;  i != c->len;  i++) {
+		idx[i] = i;
+	}
+	ffsort(idx, c->len, sizeof(ffuint), _ffpack_catalog_size_cmp, c->comp_size.ptr);
+}
+
+#define FFPACK_FNV1A64_INIT  0xcbf29ce484222325ULL
+
+/** 64-bit FNV-1a hash
+h: FFPACK_FNV1A64_INIT or the result of the previous call */
+static inline ffuint64 ffpack_fnv1a64(ffuint64 h, const void *data, ffsize len)
+{
+	const ffbyte *d = (ffbyte*)data;
+	for (ffsize i = 0;  i != len;  i++) {
+		h = (h ^ d[i]) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static inline ffuint _ffpack_fnv1a32(const void *data, ffsize len)
+{
+	const ffbyte *d = (ffbyte*)data;
+	ffuint h = 0x811c9dc5;
+	for (ffsize i = 0;  i != len;  i++) {
+		h = (h ^ d[i]) * 0x01000193;
+	}
+	return h;
+}
+
+/** Find entry by name
+Return entry index
+  <0 if not found */
+static inline ffssize ffpack_catalog_find(const ffpack_catalog *c, ffstr name)
+{
+	const ffuint *hash = (c->name_hash.len == c->len) ? (ffuint*)c->name_hash.ptr : NULL;
+	ffuint h = (hash != NULL) ? _ffpack_fnv1a32(name.ptr, name.len) : 0;
+	for (ffsize i = 0;  i != c->len;  i++) {
+		if (hash != NULL && hash[i] != h)
+			continue;
+		ffstr s = ffpack_catalog_name(c, i);
+		if (ffstr_eq2(&s, &name))
+			return i;
+	}
+	return -1;
+}
+
+
+/* Serialized catalog:
+header
+ffuint64 hdr_offset[]
+ffuint64 comp_size[]
+ffuint64 size[]
+ffint64 mtime[]
+ffuint crc[]
+ffuint attr[]
+ffuint name_off[]
+ffuint name_hash[]
+ffushort method[]
+(padding to 8 bytes)
+char names[]
+
+All numbers are in host byte order;
+ the data is rejected by a host with different byte order or word size.
+Each array is naturally aligned, so the data may be used in place (e.g. from a mapped file).
+*/
+
+#define FFPACK_CATALOG_MAGIC  "FFPCAT"
+#define FFPACK_CATALOG_VER  1
+
+/** Properties of the archive file which the catalog describes.
+A saved catalog is valid only while these values match. */
+typedef struct ffpack_catalog_valid {
+	ffuint64 archive_size;
+	ffint64 archive_mtime; // seconds since 1970
+	ffuint64 meta_hash; // ffpack_catalog.meta_hash; 0: don't check
+} ffpack_catalog_valid;
+
+struct _ffpack_catalog_hdr {
+	char magic[6]; // "FFPCAT"
+	ffbyte ver;
+	ffbyte word_size; // sizeof(void*)
+	ffuint byte_order; // 0x01020304
+	ffuint reserved;
+	ffuint64 archive_size;
+	ffint64 archive_mtime;
+	ffuint64 meta_hash;
+	ffuint64 data_end;
+	ffuint64 entries;
+	ffuint64 names_len;
+};
+
+static inline ffsize _ffpack_catalog_size(ffuint64 n, ffuint64 names_len)
+{
+	ffuint64 sz = sizeof(struct _ffpack_catalog_hdr)
+		+ n * (8 * 4 + 4 * 4 + 2);
+	sz = ffint_align_ceil2(sz, 8) + names_len;
+	return sz;
+}
+
+/** Serialize catalog
+v: archive properties
+out: (output) data is appended
+Return 0 on success */
+static inline int ffpack_catalog_save(const ffpack_catalog *c, const ffpack_catalog_valid *v, ffvec *out)
+{
+	ffsize total = _ffpack_catalog_size(c->len, c->names.len);
+	if (NULL == ffvec_growT(out, total, char))
+		return -1;
+	char *d = ffslice_endT(out, char), *p = d;
+	ffmem_zero(d, total);
+
+	struct _ffpack_catalog_hdr *h = (struct _ffpack_catalog_hdr*)p;
+	ffmem_copy(h->magic, FFPACK_CATALOG_MAGIC, 6);
+	h->ver = FFPACK_CATALOG_VER;
+	h->word_size = sizeof(void*);
+	h->byte_order = 0x01020304;
+	h->archive_size = v->archive_size;
+	h->archive_mtime = v->archive_mtime;
+	h->meta_hash = c->meta_hash;
+	h->data_end = c->data_end;
+	h->entries = c->len;
+	h->names_len = c->names.len;
+	p += sizeof(*h);
+
+	ffsize n = c->len;
+	ffmem_copy(p, c->hdr_offset.ptr, n * 8);  p += n * 8;
+	ffmem_copy(p, c->comp_size.ptr, n * 8);  p += n * 8;
+	ffmem_copy(p, c->size.ptr, n * 8);  p += n * 8;
+	ffmem_copy(p, c->mtime.ptr, n * 8);  p += n * 8;
+	ffmem_copy(p, c->crc.ptr, n * 4);  p += n * 4;
+	ffmem_copy(p, c->attr.ptr, n * 4);  p += n * 4;
+	ffmem_copy(p, c->name_off.ptr, n * 4);  p += n * 4;
+
+	ffuint *hash = (ffuint*)p;
+	for (ffsize i = 0;  i != n;  i++) {
+		ffstr s = ffpack_catalog_name(c, i);
+		hash[i] = _ffpack_fnv1a32(s.ptr, s.len);
+	}
+	p += n * 4;
+
+	ffmem_copy(p, c->method.ptr, n * 2);  p += n * 2;
+	p = d + ffint_align_ceil2(p - d, 8);
+	ffmem_copy(p, c->names.ptr, c->names.len);
+
+	out->len += total;
+	return 0;
+}
+
+static inline void _ffpack_catalog_view(ffvec *a, const char **p, ffsize n, ffsize elsize)
+{
+	a->ptr = (void*)*p;
+	a->len = n;
+	a->cap = 0;
+	*p += n * elsize;
+}
+
+/** Initialize catalog from serialized data without copying.
+The catalog references 'data' which must stay valid and be 8-byte aligned.
+v: the current archive properties
+Return 0 on success
+  -1: bad or incompatible data
+  -2: catalog is stale (archive properties don't match) */
+static inline int ffpack_catalog_load(ffpack_catalog *c, const void *data, ffsize len, const ffpack_catalog_valid *v)
+{
+	const struct _ffpack_catalog_hdr *h = (struct _ffpack_catalog_hdr*)data;
+	if (len < sizeof(*h)
+		|| ((ffsize)data & 7)
+		|| !!ffmem_cmp(h->magic, FFPACK_CATALOG_MAGIC, 6)
+		|| h->ver != FFPACK_CATALOG_VER
+		|| h->word_size != sizeof(void*)
+		|| h->byte_order != 0x01020304
+		|| h->entries > len
+		|| h->names_len > 0xffffffff
+		|| _ffpack_catalog_size(h->entries, h->names_len) != len)
+		return -1;
+
+	if (h->archive_size != v->archive_size
+		|| h->archive_mtime != v->archive_mtime
+		|| (v->meta_hash != 0 && h->meta_hash != v->meta_hash))
+		return -2;
+
+	ffsize n = h->entries;
+	const char *p = (char*)data + sizeof(*h);
+	ffmem_zero_obj(c);
+	c->len = n;
+	c->meta_hash = h->meta_hash;
+	c->data_end = h->data_end;
+	_ffpack_catalog_view(&c->hdr_offset, &p, n, 8);
+	_ffpack_catalog_view(&c->comp_size, &p, n, 8);
+	_ffpack_catalog_view(&c->size, &p, n, 8);
+	_ffpack_catalog_view(&c->mtime, &p, n, 8);
+	_ffpack_catalog_view(&c->crc, &p, n, 4);
+	_ffpack_catalog_view(&c->attr, &p, n, 4);
+	_ffpack_catalog_view(&c->name_off, &p, n, 4);
+	_ffpack_catalog_view(&c->name_hash, &p, n, 4);
+	_ffpack_catalog_view(&c->method, &p, n, 2);
+	p = (char*)data + ffint_align_ceil2(p - (char*)data, 8);
+	_ffpack_catalog_view(&c->names, &p, h->names_len, 1);
+
+	// name offsets must be ascending and each name must be NULL-terminated
+	const ffuint *name_off = (ffuint*)c->name_off.ptr;
+	const char *names = (char*)c->names.ptr;
+	for (ffsize i = 0;  i != n;  i++) {
+		ffsize end = (i + 1 != n) ? name_off[i + 1] : c->names.len;
+		if (name_off[i] >= end
+			|| end > c->names.len
+			|| names[end - 1] != '\0') {
+			ffmem_zero_obj(c);
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,128 @@
+/** ffpack: SHA-256 hash (FIPS 180-4)
+2026 */
+
+/*
+ffpack_sha256_init ffpack_sha256_update ffpack_sha256_fin
+ffpack_sha256_calc
+*/
+
+#pragma once
+
+#include <ffbase/base.h>
+
+typedef struct ffpack_sha256 {
+	ffuint h[8];
+	ffuint64 len; // total input size
+	ffbyte buf[64];
+} ffpack_sha256;
+
+static inline void ffpack_sha256_init(ffpack_sha256 *s)
+{
+	static const ffuint h0[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	for (ffuint i = 0;  i != 8;  i++) {
+		s->h[i] = h0[i];
+	}
+	s->len = 0;
+}
+
+#define _FFPACK_ROR32(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline void _ffpack_sha256_block(ffpack_sha256 *s, const ffbyte *d)
+{
+	static const ffuint k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+	};
+	ffuint w[64], a, b, c, e, f, g, h, dd, t1, t2;
+
+	for (ffuint i = 0;  i != 16;  i++) {
+		w[i] = ((ffuint)d[i*4] << 24) | ((ffuint)d[i*4+1] << 16) | ((ffuint)d[i*4+2] << 8) | d[i*4+3];
+	}
+	for (ffuint i = 16;  i != 64;  i++) {
+		ffuint s0 = _FFPACK_ROR32(w[i-15], 7) ^ _FFPACK_ROR32(w[i-15], 18) ^ (w[i-15] >> 3);
+		ffuint s1 = _FFPACK_ROR32(w[i-2], 17) ^ _FFPACK_ROR32(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	a = s->h[0];  b = s->h[1];  c = s->h[2];  dd = s->h[3];
+	e = s->h[4];  f = s->h[5];  g = s->h[6];  h = s->h[7];
+	for (ffuint i = 0;  i != 64;  i++) {
+		t1 = h + (_FFPACK_ROR32(e, 6) ^ _FFPACK_ROR32(e, 11) ^ _FFPACK_ROR32(e, 25))
+			+ ((e & f) ^ (~e & g)) + k[i] + w[i];
+		t2 = (_FFPACK_ROR32(a, 2) ^ _FFPACK_ROR32(a, 13) ^ _FFPACK_ROR32(a, 22))
+			+ ((a & b) ^ (a & c) ^ (b & c));
+		h = g;  g = f;  f = e;  e = dd + t1;
+		dd = c;  c = b;  b = a;  a = t1 + t2;
+	}
+	s->h[0] += a;  s->h[1] += b;  s->h[2] += c;  s->h[3] += dd;
+	s->h[4] += e;  s->h[5] += f;  s->h[6] += g;  s->h[7] += h;
+}
+
+#undef _FFPACK_ROR32
+
+static inline void ffpack_sha256_update(ffpack_sha256 *s, const void *data, ffsize len)
+{
+	const ffbyte *d = (ffbyte*)data;
+	ffuint n = s->len % 64;
+	s->len += len;
+
+	if (n != 0) {
+		ffsize k = ffmin(64 - n, len);
+		ffmem_copy(s->buf + n, d, k);
+		d += k;
+		len -= k;
+		if (n + k != 64)
+			return;
+		_ffpack_sha256_block(s, s->buf);
+	}
+
+	for (;  len >= 64;  len -= 64) {
+		_ffpack_sha256_block(s, d);
+		d += 64;
+	}
+	ffmem_copy(s->buf, d, len);
+}
+
+/**
+result: (output) 32 bytes */
+static inline void ffpack_sha256_fin(ffpack_sha256 *s, ffbyte *result)
+{
+	ffuint64 bits = s->len * 8;
+	ffuint n = s->len % 64;
+	s->buf[n++] = 0x80;
+	if (n > 56) {
+		ffmem_zero(s->buf + n, 64 - n);
+		_ffpack_sha256_block(s, s->buf);
+		n = 0;
+	}
+	ffmem_zero(s->buf + n, 56 - n);
+	for (ffuint i = 0;  i != 8;  i++) {
+		s->buf[56 + i] = (ffbyte)(bits >> (56 - i * 8));
+	}
+	_ffpack_sha256_block(s, s->buf);
+
+	for (ffuint i = 0;  i != 8;  i++) {
+		result[i*4] = (ffbyte)(s->h[i] >> 24);
+		result[i*4+1] = (ffbyte)(s->h[i] >> 16);
+		result[i*4+2] = (ffbyte)(s->h[i] >> 8);
+		result[i*4+3] = (ffbyte)s->h[i];
+	}
+}
+
+/** Get SHA-256 hash of data
+result: (output) 32 bytes */
+static inline void ffpack_sha256_calc(const void *data, ffsize len, ffbyte *result)
+{
+	ffpack_sha256 s;
+	ffpack_sha256_init(&s);
+	ffpack_sha256_update(&s, data, len);
+	ffpack_sha256_fin(&s, result);
+}
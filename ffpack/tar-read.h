@@ -5,6 +5,7 @@
 fftarread_open
 fftarread_close
 fftarread_process
+fftarread_skip
 fftarread_offset
 fftarread_error
 fftarread_fileinfo
@@ -28,6 +29,7 @@ typedef struct fftarread {
 	ffuint64 size;
 	fftarread_fileinfo_t fileinfo;
 	int long_name;
+	ffuint skip :1;
 } fftarread;
 
 enum FFTARREAD_R {
@@ -55,6 +57,10 @@ enum FFTARREAD_R {
 
 	/* Fatal error */
 	FFTARREAD_ERROR,
+
+	/* Need input data at offset fftarread_offset()
+	Expecting fftarread_process() with input data from the new offset */
+	FFTARREAD_SEEK,
 };
 
 /** Get input offset */
@@ -75,6 +81,15 @@ static inline fftarread_fileinfo_t* fftarread_fileinfo(fftarread *t)
 	return &t->fileinfo;
 }
 
+/** Skip the rest of the current file's data and padding (seekable input only)
+Call after FFTARREAD_FILEHEADER or FFTARREAD_DATA:
+ fftarread_process() returns FFTARREAD_SEEK, then FFTARREAD_FILEHEADER for the next file.
+No effect if the file data is already read. */
+static inline void fftarread_skip(fftarread *t)
+{
+	t->skip = 1;
+}
+
 static inline int fftarread_open(fftarread *t)
 {
 	ffmem_zero_obj(t);
@@ -207,6 +222,13 @@ static inline int fftarread_process(fftarread *t, ffstr *input, ffstr *output)
 			continue;
 
 		case R_DATA:
+			if (t->skip) {
+				t->skip = 0;
+				t->offset += t->size + ffint_align_ceil2(t->fileinfo.size, 512) - t->fileinfo.size;
+				t->gather_size = 512;
+				t->state = R_GATHER;  t->state_next = R_HDR;
+				return FFTARREAD_SEEK;
+			}
 			if (input->len == 0)
 				return FFTARREAD_MORE;
 			ffstr_set(output, input->ptr, ffmin64(t->size, input->len));
@@ -232,6 +254,7 @@ static inline int fftarread_process(fftarread *t, ffstr *input, ffstr *output)
 			// fallthrough
 
 		case R_FDONE:
+			t->skip = 0;
 			t->gather_size = 512;
 			t->state = R_GATHER;  t->state_next = R_HDR;
 			return FFTARREAD_FILEDONE;
@@ -27,12 +27,23 @@ static void _ffzipr_zstd_close(ffzipread *z)
 static int _ffzipr_zstd_unpack(ffzipread *z, ffstr input, ffstr *output, ffsize *rd)
 {
 	int done = (*rd == 0);
+	if (z->stream_end) {
+		*rd = 0;
+		return 0xa11;
+	}
+
 	zstd_buf in, out;
 	zstd_buf_set(&in, input.ptr, input.len);
 	zstd_buf_set(&out, z->buf.ptr, z->buf.cap);
 	int r = zstd_decode(z->zstd, &in, &out);
 	*rd = in.pos;
 
+	if (r == 0 && z->file_comp_size == (ffuint64)-1) {
+		// frame is complete; compressed size is unknown
+		z->stream_end = 1;
+		done = 1;
+	}
+
 	if (r < 0) {
 		ffmem_free(z->error_buf);
 		z->error_buf = ffsz_allocfmt("zstd_decode: %s", zstd_error(r));
@@ -22,6 +22,7 @@ ffzipread_fileread
 #pragma once
 
 #include <ffpack/path.h>
+#include <ffpack/catalog.h>
 #include <ffpack/base/zip.h>
 #include <ffbase/vector.h>
 #include <ffbase/string.h>
@@ -30,6 +31,11 @@ struct z_ctx;
 struct zstd_decoder;
 typedef struct ffzipread ffzipread;
 typedef struct zip_fileinfo ffzipread_fileinfo_t;
+typedef struct ffzipread_range {
+	ffuint64 offset; // absolute offset of file data within archive
+	ffuint64 size;
+	ffuint crc; // expected CRC (0 if the file has a data descriptor)
+} ffzipread_range_t;
 typedef void (*ffzipread_log)(void *udata, ffuint level, ffstr msg);
 typedef int (*_ffzipread_unpack)(ffzipread *z, ffstr input, ffstr *output, ffsize *rd);
 
@@ -39,7 +45,8 @@ struct ffzipread {
 	const char *error;
 	ffvec buf;
 	ffuint64 offset; // current offset
-	ffuint64 cdir_end; // offset where CDIR ends
+	ffuint64 cdir_off, cdir_end; // offset where CDIR begins/ends
+	ffuint64 skip_to; // ffzipread_fileread_next()
 	ffuint64 file_rd, file_wr;
 	ffuint crc; // current CRC
 
@@ -57,6 +64,10 @@ struct ffzipread {
 	char *error_buf;
 	ffuint have_ftrl :1;
 	ffuint zip64_ftrl :1;
+	ffuint crc_skip :1;
+	ffuint stream :1; // ffzipread_open_stream()
+	ffuint stream_end :1; // decoder has reached the end of compressed data (unknown size)
+	ffzipread_range_t range;
 
 	/* Code page for non-Unicode file names. enum FFUNICODE_CP
 	default: FFUNICODE_WIN1252 */
@@ -67,6 +78,20 @@ struct ffzipread {
 
 	/* Offset in seconds for the current local time (GMT+XX) */
 	int timezone_offset;
+
+	/* If set, the whole CDIR is read at once and all its entries are added to this catalog.
+	FFZIPREAD_FILEINFO is not returned. */
+	ffpack_catalog *catalog;
+
+	/* Return FFZIPREAD_RANGE for STORED files instead of their data */
+	ffuint stored_ranges :1;
+
+	/* Return file data as is, without decompression and CRC check (e.g. to copy it to another archive).
+	With 'stored_ranges', FFZIPREAD_RANGE is returned for all files. */
+	ffuint raw :1;
+
+	const char *map; // the whole archive data (ffzipread_open_mapped())
+	ffuint64 map_len;
 };
 
 /** Prepare for reading
@@ -74,6 +99,21 @@ total_size: .zip file size
 Return 0 on success */
 static int ffzipread_open(ffzipread *z, ffint64 total_size);
 
+/** Prepare for reading the whole archive from memory (e.g. a mapped file).
+Input data is taken directly from 'data' without copying:
+ ffzipread_process() doesn't return FFZIPREAD_SEEK or FFZIPREAD_MORE and ignores 'input'.
+data: must stay valid until the reader is closed
+Return 0 on success */
+static int ffzipread_open_mapped(ffzipread *z, const void *data, ffsize len);
+
+/** Prepare for reading the archive sequentially from the beginning (e.g. from a pipe).
+Local file headers are parsed in order, CDIR isn't used; FFZIPREAD_SEEK is never returned.
+For files with data descriptor the compressed size is found by the decoder's end of stream,
+ so STORED files with data descriptor aren't supported.
+Sequence: FILEHEADER, DATA..., FILEDONE, FILEHEADER, ..., DONE.
+Return 0 on success */
+static int ffzipread_open_stream(ffzipread *z);
+
 /** Close reader */
 static void ffzipread_close(ffzipread *z);
 
@@ -112,6 +152,11 @@ enum FFZIPREAD_R {
 
 	/* Fatal error */
 	FFZIPREAD_ERROR,
+
+	/* (ffzipread.stored_ranges) Data of STORED file is at ffzipread_range() within archive.
+	The data is not read by ffzipread, and CRC is not checked.
+	Expecting ffzipread_process() with input data at ffzipread_offset() */
+	FFZIPREAD_RANGE,
 };
 
 /** Read the next chunk
@@ -131,12 +176,25 @@ static inline const char* ffzipread_error(ffzipread *z)
 	return z->error;
 }
 
+/** Get CDIR location within archive (after FFZIPREAD_DONE) */
+static inline void ffzipread_cdir(ffzipread *z, ffuint64 *offset, ffuint64 *size)
+{
+	*offset = z->cdir_off;
+	*size = z->cdir_end - z->cdir_off;
+}
+
 /** Get info from CDIR entry */
 static inline ffzipread_fileinfo_t* ffzipread_fileinfo(ffzipread *z)
 {
 	return &z->fileinfo;
 }
 
+/** Get location of STORED file data */
+static inline const ffzipread_range_t* ffzipread_range(ffzipread *z)
+{
+	return &z->range;
+}
+
 /** Prepare for reading a file
 hdr_offset: file header offset from CDIR
 comp_size: compressed (on-disk) file size from CDIR */
@@ -147,6 +205,116 @@ static inline void ffzipread_fileread(ffzipread *z, ffuint64 hdr_offset, ffuint6
 	z->file_comp_size = comp_size;
 }
 
+/** Prepare for reading the next file which is located after the current position,
+ without FFZIPREAD_SEEK: the input data up to its header is skipped.
+Use after ffzipread_fileread() for the next entries within the same read plan range.
+Falls back to ffzipread_fileread() if the file header is behind the current position. */
+static inline void ffzipread_fileread_next(ffzipread *z, ffuint64 hdr_offset, ffuint64 comp_size)
+{
+	if (hdr_offset < z->offset) {
+		ffzipread_fileread(z, hdr_offset, comp_size);
+		return;
+	}
+	z->state = 40; // R_FHDR_SKIP
+	z->skip_to = hdr_offset;
+	z->file_comp_size = comp_size;
+}
+
+/** Prepare for reading a file from the catalog filled by another reader.
+Each worker thread uses its own ffzipread object, while the catalog is shared read-only.
+The reader starts with FFZIPREAD_SEEK to the file header,
+ so the caller reads input data at the returned offsets (e.g. pread()).
+After FFZIPREAD_FILEDONE the same object may be reused for the next file with this function.
+parent: reader whose settings (code page, time zone, log) are copied; may be NULL
+Return 0 on success */
+static inline int ffzipread_open_file(ffzipread *z, const ffzipread *parent, const ffpack_catalog *c, ffsize i)
+{
+	if (z->buf.ptr == NULL) {
+		if (0 != ffzipread_open(z, 0))
+			return -1;
+		if (parent != NULL) {
+			z->codepage = parent->codepage;
+			z->timezone_offset = parent->timezone_offset;
+			z->log = parent->log;
+			z->udata = parent->udata;
+		}
+	}
+
+	if (i >= c->len)
+		return -1;
+	ffzipread_fileread(z, ((ffuint64*)c->hdr_offset.ptr)[i], ((ffuint64*)c->comp_size.ptr)[i]);
+	return 0;
+}
+
+
+typedef struct ffzipread_plan_range {
+	ffuint64 offset, size; // area within archive
+	ffuint first, n; // entries [first..first+n) of the sorted array of entry indexes
+} ffzipread_plan_range_t;
+
+static int _ffzipread_u64_cmp(const void *a, const void *b, void *udata)
+{
+	(void)udata;
+	ffuint64 oa = *(ffuint64*)a, ob = *(ffuint64*)b;
+	return (oa < ob) ? -1 : (oa > ob);
+}
+
+static int _ffzipread_hdr_offset_cmp(const void *a, const void *b, void *udata)
+{
+	const ffuint64 *hdr_offset = (ffuint64*)udata;
+	return _ffzipread_u64_cmp(&hdr_offset[*(ffuint*)a], &hdr_offset[*(ffuint*)b], NULL);
+}
+
+/** Build read plan for extracting the specified catalog entries
+ (filled by ffzipread or loaded with ffpack_catalog_load()).
+An entry occupies the area from its header to the next entry's header (or CDIR: c->data_end).
+The areas are sorted by offset and merged if the distance between them isn't larger than 'gap'.
+The caller reads each range with a single request and passes it to the reader:
+ ffzipread_fileread() for the first entry of the range, then ffzipread_fileread_next().
+idx: entry indexes; sorted by offset on return
+plan: (output) ffzipread_plan_range_t[]
+Return 0 on success */
+static inline int ffzipread_plan(const ffpack_catalog *c, ffuint *idx, ffsize n, ffuint64 gap, ffvec *plan)
+{
+	const ffuint64 *hdr_offset = (ffuint64*)c->hdr_offset.ptr;
+	ffvec all = {};
+	if (NULL == ffvec_allocT(&all, c->len, ffuint64))
+		return -1;
+	ffvec_addT(&all, hdr_offset, c->len, ffuint64);
+	ffsort(all.ptr, all.len, sizeof(ffuint64), _ffzipread_u64_cmp, NULL);
+	ffsort(idx, n, sizeof(ffuint), _ffzipread_hdr_offset_cmp, (void*)hdr_offset);
+
+	const ffuint64 *sorted = (ffuint64*)all.ptr;
+	ffsize k = 0;
+	ffzipread_plan_range_t *r = NULL;
+	for (ffsize i = 0;  i != n;  i++) {
+		ffuint64 off = hdr_offset[idx[i]];
+		while (k != all.len && sorted[k] <= off) {
+			k++;
+		}
+		ffuint64 end = (k != all.len) ? sorted[k] : c->data_end;
+		end = ffmax64(end, off);
+
+		if (r != NULL && off <= r->offset + r->size + gap) {
+			r->size = ffmax64(end, r->offset + r->size) - r->offset;
+			r->n++;
+			continue;
+		}
+
+		if (NULL == (r = ffvec_pushT(plan, ffzipread_plan_range_t))) {
+			ffvec_free(&all);
+			return -1;
+		}
+		r->offset = off;
+		r->size = end - off;
+		r->first = i;
+		r->n = 1;
+	}
+
+	ffvec_free(&all);
+	return 0;
+}
+
 
 #ifdef FFPACK_ZIPREAD_ZLIB
 	#include <ffpack/zip-read-libz.h>
@@ -167,6 +335,24 @@ static inline int ffzipread_open(ffzipread *z, ffint64 total_size)
 	return 0;
 }
 
+static inline int ffzipread_open_mapped(ffzipread *z, const void *data, ffsize len)
+{
+	if (0 != ffzipread_open(z, len))
+		return -1;
+	z->map = (char*)data;
+	z->map_len = len;
+	return 0;
+}
+
+static inline int ffzipread_open_stream(ffzipread *z)
+{
+	if (0 != ffzipread_open(z, 0))
+		return -1;
+	z->stream = 1;
+	z->state = 50; // R_STREAM_NEXT
+	return 0;
+}
+
 static inline void ffzipread_close(ffzipread *z)
 {
 	ffvec_free(&z->buf);
@@ -220,7 +406,7 @@ static inline int _ffzipread_fn_copy(ffzipread *z, ffstr fn)
 }
 
 /** Process CDIR entry's extra data */
-static inline int _ffzipread_extra(ffzipread *z, const void *cdir_data, const void *fhdr_data, ffstr extra)
+static inline int _ffzipread_extra(ffzipread *z, struct zip_fileinfo *info, const void *cdir_data, const void *fhdr_data, ffstr extra)
 {
 	z->zip64_ftrl = 0;
 
@@ -236,29 +422,90 @@ static inline int _ffzipread_extra(ffzipread *z, const void *cdir_data, const vo
 		switch (id) {
 		case 0x0001:
 			if (cdir_data != NULL)
-				(void) zip_extra_cdir64_read(val, cdir_data, &z->fileinfo);
+				(void) zip_extra_cdir64_read(val, cdir_data, info);
 			else {
-				zip_extra_fhdr64_read(val, fhdr_data, &z->fileinfo);
+				zip_extra_fhdr64_read(val, fhdr_data, info);
 				z->zip64_ftrl = 1;
 			}
 			break;
 
 		case 0x000A:
-			(void) zip_extra_ntfs_read(val, &z->fileinfo);
+			(void) zip_extra_ntfs_read(val, info);
 			break;
 
 		case 0x5455: // "UT"
-			(void) zip_extra_unixtime_read(val, &z->fileinfo);
+			(void) zip_extra_unixtime_read(val, info);
 			break;
 
 		case 0x7875: // "ux"
-			(void) zip_extra_newunix_read(val, &z->fileinfo);
+			(void) zip_extra_newunix_read(val, info);
 			break;
 		}
 	}
 	return 0;
 }
 
+/** Parse all CDIR entries at once and add them to the catalog */
+static inline int _ffzipread_cdir_bulk(ffzipread *z, ffstr data)
+{
+	ffpack_catalog *c = z->catalog;
+	c->meta_hash = ffpack_fnv1a64(FFPACK_FNV1A64_INIT, data.ptr, data.len);
+	c->data_end = z->cdir_off;
+
+	while (data.len != 0) {
+		struct zip_fileinfo info = {};
+		int r;
+		if (data.len < sizeof(struct zip_cdir)
+			|| (r = zip_cdir_read(data.ptr, &info, z->timezone_offset)) < 0
+			|| (ffsize)r > data.len) {
+			z->error = "zip_cdir_read";
+			return -1;
+		}
+
+		const struct zip_cdir *cdir = (struct zip_cdir*)data.ptr;
+		ffuint filenamelen = ffint_le_cpu16_ptr(cdir->filenamelen);
+		ffstr fn, extra;
+		ffstr_set(&fn, cdir->filename, filenamelen);
+		ffstr_set(&extra, cdir->filename + filenamelen, ffint_le_cpu16_ptr(cdir->extralen));
+		(void) _ffzipread_extra(z, &info, cdir, NULL, extra);
+
+		ffssize i = _ffpack_catalog_push(c);
+		if (i < 0)
+			return -1;
+		((ffuint64*)c->hdr_offset.ptr)[i] = info.hdr_offset;
+		((ffuint64*)c->comp_size.ptr)[i] = info.compressed_size;
+		((ffuint64*)c->size.ptr)[i] = info.uncompressed_size;
+		((ffuint*)c->crc.ptr)[i] = info.uncompressed_crc;
+		((ffushort*)c->method.ptr)[i] = info.compress_method;
+		((ffint64*)c->mtime.ptr)[i] = info.mtime.sec;
+		((ffuint*)c->attr.ptr)[i] = (info.attr_unix << 16) | info.attr_win;
+		((ffuint*)c->name_off.ptr)[i] = c->names.len;
+
+		if (!ffutf8_valid(fn.ptr, fn.len)) {
+			// rare case: convert to UTF-8 via a temporary buffer
+			if (0 != _ffzipread_fn_copy(z, fn))
+				return -1;
+			fn = z->fileinfo.name;
+		}
+
+		if (c->names.len + fn.len + 1 > 0xffffffff) {
+			z->error = "too large CDIR";
+			return -1;
+		}
+		if (NULL == ffvec_growtwiceT(&c->names, fn.len + 1, char))
+			return -1;
+		char *name = ffslice_endT(&c->names, char);
+		ffsize n = _ffpack_path_normalize(name, fn.len, fn.ptr, fn.len
+			, _FFPACK_PATH_FORCE_SLASH | _FFPACK_PATH_SIMPLE);
+		name[n] = '\0';
+		c->names.len += n + 1;
+
+		ffstr_shift(&data, r);
+	}
+
+	return 0;
+}
+
 /** Fast CRC32 implementation using 8k table */
 FF_EXTERN ffuint crc32(const void *buf, ffsize size, ffuint crc);
 
@@ -284,6 +531,7 @@ static inline int _ffzipread_stored_unpack(ffzipread *z, ffstr input, ffstr *out
   . read zip64 CDIR locator, get zip64 CDIR trailer offset
   . read zip64 CDIR trailer, get CDIR offset
 . read entries from CDIR
+  or gather the whole CDIR and fill the catalog
 . return FFZIPREAD_DONE
 
 . after ffzipread_fileread() has been called by user, seek to local file header
@@ -291,15 +539,25 @@ static inline int _ffzipread_stored_unpack(ffzipread *z, ffstr input, ffstr *out
 . decompress data
 . [read file trailer]
 . perform CRC check
+
+Streaming mode:
+. read file header signature
+  . "PK\1\2" (CDIR) or "PK\5\6" (CDIR trailer): return FFZIPREAD_DONE
+. read file header
+. decompress data until the decoder signals the end of stream
+. [read file trailer; check its compressed size]
+. perform CRC check
 */
-static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
+static inline int _ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 {
 	ffssize r;
 	ffstr data = {};
 	enum {
-		R_CDIR_TRL_SEEK, R_CDIR_TRL, R_CDIR64_LOC, R_CDIR64, R_CDIR_NEXT, R_CDIR, R_CDIR_DATA,
-		R_FHDR_SEEK = 20, R_FHDR, R_FHDR_DATA, R_DATA, R_FTRL, R_FTRL64, R_FILEDONE, R_FILEDONE2, R_DONE,
+		R_CDIR_TRL_SEEK, R_CDIR_TRL, R_CDIR64_LOC, R_CDIR64, R_CDIR_NEXT, R_CDIR, R_CDIR_DATA, R_CDIR_BULK,
+		R_FHDR_SEEK = 20, R_FHDR, R_FHDR_DATA, R_DATA, R_RANGE, R_FTRL_SEEK, R_FTRL, R_FTRL64, R_FILEDONE, R_FILEDONE2, R_DONE,
 		R_GATHER, R_GATHER_MORE,
+		R_FHDR_SKIP = 40,
+		R_STREAM_NEXT = 50, R_STREAM_SIG, R_FTRL_SIG,
 	};
 
 	for (;;) {
@@ -314,7 +572,12 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 		}
 
 		case R_GATHER_MORE:
-			if (z->buf.ptr == data.ptr)
+			if (z->map != NULL && data.ptr + data.len == input->ptr) {
+				// mapped input: gather again from the same position without copying
+				input->ptr -= data.len;
+				input->len += data.len;
+				z->offset -= data.len;
+			} else if (z->buf.ptr == data.ptr)
 				z->buf.len = data.len;
 			else
 				ffvec_add2T(&z->buf, &data, char);
@@ -361,6 +624,7 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 				return FFZIPREAD_SEEK;
 			}
 
+			z->cdir_off = cdir_offset;
 			z->cdir_end = cdir_offset + cdir_size;
 			z->offset = cdir_offset;
 			z->state = R_CDIR_NEXT;
@@ -398,6 +662,7 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 				return FFZIPREAD_ERROR;
 			}
 
+			z->cdir_off = cdir_offset;
 			z->cdir_end = cdir_offset + cdir_size;
 			z->offset = cdir_offset;
 			z->state = R_CDIR_NEXT;
@@ -405,6 +670,16 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 		}
 
 		case R_CDIR_NEXT:
+			if (z->catalog != NULL && z->offset < z->cdir_end) {
+				if (z->cdir_end - z->offset > 0xffffffff) {
+					z->error = "too large CDIR";
+					return FFZIPREAD_ERROR;
+				}
+				z->gather_size = z->cdir_end - z->offset;
+				z->state = R_GATHER;  z->state_next = R_CDIR_BULK;
+				break;
+			}
+
 			if (z->offset + sizeof(struct zip_cdir) > z->cdir_end)
 				return FFZIPREAD_DONE;
 
@@ -433,7 +708,7 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 			}
 
 			ffstr_shift(&data, sizeof(struct zip_cdir) + filenamelen);
-			if (0 != _ffzipread_extra(z, cdir, NULL, data)) {
+			if (0 != _ffzipread_extra(z, &z->fileinfo, cdir, NULL, data)) {
 				return FFZIPREAD_ERROR;
 			}
 
@@ -441,11 +716,35 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 			return FFZIPREAD_FILEINFO;
 		}
 
+		case R_CDIR_BULK:
+			if (0 != _ffzipread_cdir_bulk(z, data))
+				return FFZIPREAD_ERROR;
+
+			if (z->buf.cap > 64*1024) {
+				// release the memory occupied by CDIR data
+				ffvec_free(&z->buf);
+				if (NULL == ffvec_allocT(&z->buf, 64*1024, char))
+					return FFZIPREAD_ERROR;
+			}
+			z->state = R_CDIR_NEXT;
+			return FFZIPREAD_DONE;
+
 		case R_FHDR_SEEK:
 			z->gather_size = sizeof(struct zip_filehdr);
 			z->state = R_GATHER;  z->state_next = R_FHDR;
 			return FFZIPREAD_SEEK;
 
+		case R_FHDR_SKIP: {
+			ffsize n = ffmin64(z->skip_to - z->offset, input->len);
+			ffstr_shift(input, n);
+			z->offset += n;
+			if (z->offset != z->skip_to)
+				return FFZIPREAD_MORE;
+			z->gather_size = sizeof(struct zip_filehdr);
+			z->state = R_GATHER;  z->state_next = R_FHDR;
+			break;
+		}
+
 		case R_FHDR: {
 			ffstr_free(&z->fileinfo.name);
 			ffmem_zero_obj(&z->fileinfo);
@@ -455,7 +754,7 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 				return FFZIPREAD_ERROR;
 			}
 
-			switch (z->fileinfo.compress_method) {
+			switch ((z->raw) ? ZIP_STORED : z->fileinfo.compress_method) {
 			case ZIP_STORED:
 				z->unpack_func = _ffzipread_stored_unpack;
 				break;
@@ -485,6 +784,8 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 			z->have_ftrl = !!(h->flags[0] & ZIP_FDATADESC);
 
 			z->crc = 0;
+			z->crc_skip = z->raw;
+			z->stream_end = 0;
 			z->file_rd = 0;
 			z->file_wr = 0;
 			z->gather_size = r;
@@ -502,14 +803,48 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 			}
 
 			ffstr_shift(&data, sizeof(struct zip_filehdr) + filenamelen);
-			if (0 != _ffzipread_extra(z, NULL, h, data)) {
+			if (0 != _ffzipread_extra(z, &z->fileinfo, NULL, h, data)) {
 				return FFZIPREAD_ERROR;
 			}
 
+			if (z->stream) {
+				z->file_comp_size = z->fileinfo.compressed_size;
+				if (z->have_ftrl) {
+					if (z->unpack_func == _ffzipread_stored_unpack) {
+						z->error = "streaming mode: STORED file with data descriptor isn't supported";
+						return FFZIPREAD_ERROR;
+					}
+					z->file_comp_size = (ffuint64)-1; // until the end of compressed stream
+				}
+			}
+
 			z->state = R_DATA;
+			if (z->stored_ranges && z->unpack_func == _ffzipread_stored_unpack)
+				z->state = R_RANGE;
 			return FFZIPREAD_FILEHEADER;
 		}
 
+		case R_RANGE:
+			z->range.offset = z->offset;
+			z->range.size = z->file_comp_size;
+			z->range.crc = (z->have_ftrl) ? 0 : z->fileinfo.uncompressed_crc;
+			z->offset += z->file_comp_size;
+			z->file_rd = z->file_comp_size;
+			z->crc_skip = 1;
+			z->state = R_FILEDONE;
+			if (z->have_ftrl)
+				z->state = R_FTRL_SEEK;
+			return FFZIPREAD_RANGE;
+
+		case R_FTRL_SEEK:
+			z->gather_size = 4 + sizeof(struct zip_filetrl);
+			z->state = R_GATHER;  z->state_next = R_FTRL;
+			if (z->zip64_ftrl) {
+				z->gather_size = 4 + sizeof(struct zip64_filetrl);
+				z->state_next = R_FTRL64;
+			}
+			return FFZIPREAD_SEEK;
+
 		case R_DATA: {
 			ffstr in;
 			ffstr_set(&in, input->ptr, ffmin(input->len, z->file_comp_size - z->file_rd));
@@ -526,11 +861,15 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 				return FFZIPREAD_MORE;
 
 			case 0xa11:
-				if (z->file_rd != z->file_comp_size)
+				if (z->file_rd != z->file_comp_size && z->file_comp_size != (ffuint64)-1)
 					return z->error = "unprocessed file data",  FFZIPREAD_ERROR;
 
 				z->state = R_FILEDONE;
-				if (z->have_ftrl) {
+				if (z->have_ftrl && z->stream) {
+					// the signature is optional: don't read beyond the trailer
+					z->gather_size = 4;
+					z->state = R_GATHER;  z->state_next = R_FTRL_SIG;
+				} else if (z->have_ftrl) {
 					z->gather_size = 4 + sizeof(struct zip_filetrl);
 					z->state = R_GATHER;  z->state_next = R_FTRL;
 					if (z->zip64_ftrl) {
@@ -552,6 +891,14 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 			return FFZIPREAD_DATA;
 		}
 
+		case R_FTRL_SIG:
+			z->gather_size = (z->zip64_ftrl) ? sizeof(struct zip64_filetrl) : sizeof(struct zip_filetrl);
+			z->state_next = (z->zip64_ftrl) ? R_FTRL64 : R_FTRL;
+			z->state = R_GATHER;
+			if (!!ffmem_cmp(data.ptr, "PK\x07\x08", 4))
+				z->state = R_GATHER_MORE; // these 4 bytes are the trailer's CRC field
+			break;
+
 		case R_FTRL:
 			zip_filetrl_read(data.ptr, &z->fileinfo);
 			z->state = R_FILEDONE;
@@ -563,16 +910,39 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 			break;
 
 		case R_FILEDONE:
-			if (z->crc != z->fileinfo.uncompressed_crc) {
+			if (z->stream && z->have_ftrl && z->fileinfo.compressed_size != z->file_rd) {
+				z->error = "compressed size from file trailer doesn't match";
+				return FFZIPREAD_ERROR;
+			}
+			if (!z->crc_skip && z->crc != z->fileinfo.uncompressed_crc) {
 				z->error = "computed CRC doesn't match CRC from header";
 				z->state = R_FILEDONE2;
 				return FFZIPREAD_WARNING;
 			}
 			// fallthrough
 		case R_FILEDONE2:
-			z->state = R_DONE;
+			z->state = (z->stream) ? R_STREAM_NEXT : R_DONE;
 			return FFZIPREAD_FILEDONE;
 
+		case R_STREAM_NEXT:
+			z->gather_size = 4;
+			z->state = R_GATHER;  z->state_next = R_STREAM_SIG;
+			break;
+
+		case R_STREAM_SIG:
+			if (!ffmem_cmp(data.ptr, "PK\x01\x02", 4)
+				|| !ffmem_cmp(data.ptr, "PK\x05\x06", 4)) {
+				z->state = R_DONE;
+				return FFZIPREAD_DONE;
+			}
+			if (!!ffmem_cmp(data.ptr, "PK\x03\x04", 4)) {
+				z->error = "bad file header signature";
+				return FFZIPREAD_ERROR;
+			}
+			z->gather_size = sizeof(struct zip_filehdr);
+			z->state = R_GATHER_MORE;  z->state_next = R_FHDR;
+			break;
+
 		case R_DONE:
 			z->error = "nothing to do";
 			return FFZIPREAD_ERROR;
@@ -583,3 +953,26 @@ static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
 		}
 	}
 }
+
+static inline int ffzipread_process(ffzipread *z, ffstr *input, ffstr *output)
+{
+	if (z->map == NULL)
+		return _ffzipread_process(z, input, output);
+
+	for (;;) {
+		ffstr in = {};
+		if (z->offset <= z->map_len)
+			ffstr_set(&in, z->map + z->offset, z->map_len - z->offset);
+
+		int r = _ffzipread_process(z, &in, output);
+		switch (r) {
+		case FFZIPREAD_SEEK:
+			continue;
+
+		case FFZIPREAD_MORE:
+			z->error = "unexpected end of file";
+			return FFZIPREAD_ERROR;
+		}
+		return r;
+	}
+}
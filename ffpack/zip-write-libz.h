@@ -52,3 +52,45 @@ static int _ffzipw_deflated_pack(void *obj, ffzipwrite *w, ffstr *input, ffstr *
 static const ffzipwrite_filter _ffzipw_deflated = {
 	_ffzipw_deflated_open, _ffzipw_deflated_close, _ffzipw_deflated_pack
 };
+
+/** Compress a part of file data: [dictionary] DATA [sync flush | final block] */
+static int _ffzipw_deflated_part(ffzipwrite_conf *conf, ffstr data, ffstr prev, ffuint last, ffvec *out)
+{
+	int rc = -1;
+	z_ctx *p;
+	z_conf zconf = {};
+	zconf.level = conf->deflate_level;
+	zconf.mem = conf->deflate_mem;
+	if (0 != z_deflate_init(&p, &zconf))
+		return -1;
+
+	if (prev.len != 0) {
+		ffstr_shift(&prev, prev.len - ffmin(prev.len, 32*1024));
+		if (0 != z_deflate_dict(p, prev.ptr, prev.len))
+			goto end;
+	}
+
+	ffuint flags = (last) ? Z_FINISH : Z_SYNC_FLUSH;
+	for (;;) {
+		if (NULL == ffvec_growT(out, 64*1024, char))
+			goto end;
+		ffsize rd = data.len, cap = ffvec_unused(out);
+		int r = z_deflate(p, data.ptr, &rd, ffslice_endT(out, char), cap, flags);
+		ffstr_shift(&data, rd);
+
+		if (r == Z_DONE) {
+			break;
+		} else if (r < 0) {
+			goto end;
+		}
+
+		out->len += r;
+		if (!last && data.len == 0 && (ffsize)r != cap)
+			break; // flushed
+	}
+	rc = 0;
+
+end:
+	z_deflate_free(p);
+	return rc;
+}
@@ -12,10 +12,18 @@ Otherwise, you must provide your own implementation for CRC32 filter
 
 /*
 ffzipwrite_destroy
+ffzipwrite_open_append
+ffzipwrite_cdir_remove
 ffzipwrite_fileadd
+ffzipwrite_conf_raw
+ffzipwrite_compress
+ffzipwrite_compress_cached
+ffzipwrite_compress_part
+ffzipwrite_crc32_combine
 ffzipwrite_filefinish
 ffzipwrite_process
 ffzipwrite_offset
+ffzipwrite_method
 ffzipwrite_finish
 ffzipwrite_error
 */
@@ -24,6 +32,8 @@ ffzipwrite_error
 
 #include <ffpack/base/zip.h>
 #include <ffpack/path.h>
+#include <ffpack/catalog.h>
+#include <ffpack/sha256.h>
 #include <ffbase/string.h>
 #include <ffbase/vector.h>
 
@@ -34,7 +44,10 @@ struct ffzipwrite {
 	const char *error;
 	ffvec buf;
 	ffvec fhdr_buf;
-	ffvec cdir; // growing CDIR data
+	ffvec cdir; // growing CDIR data (the last segment)
+	ffvec cdir_segs; // ffvec[]: full CDIR segments
+	ffuint64 cdir_segs_size; // total size of data in 'cdir_segs'
+	ffuint cdir_seg_out; // the number of segments passed to user
 	ffuint64 file_rd, file_wr;
 	ffuint64 total_rd, total_wr;
 	ffuint crc; // current CRC of uncompressed data
@@ -49,10 +62,24 @@ struct ffzipwrite {
 		void *obj;
 	} filters[2];
 	ffuint filter_cur;
+	ffuint file_raw;
+	ffuint file_known; // 'raw_crc' and 'raw_size' are known for ZIP_STORED data
+	ffuint raw_crc;
+	ffuint64 raw_size, raw_comp_size;
+	ffuint append_seek;
+	ffuint method; // enum ZIP_COMP
+	ffuint auto_select, sample_pending;
+	ffvec sample; // the beginning of input data for auto selection of compression method
+	ffstr sample_in;
+	struct ffzipwrite_conf *auto_conf;
 
 	/* If TRUE, the writer won't ask user to seek on output file */
 	ffuint non_seekable;
 
+	/* Pass full CDIR segments to user (FFZIPWRITE_CDIR_SPILL) instead of keeping them in memory,
+	 so the memory usage doesn't depend on the number of files */
+	ffuint cdir_spill;
+
 	/* Offset in seconds for the current local time (GMT+XX) */
 	int timezone_offset;
 
@@ -71,8 +98,28 @@ typedef struct ffzipwrite_conf {
 	ffuint attr_win, attr_unix; // Windows/UNIX file attributes
 	ffuint uid, gid; // UNIX user/group ID
 	enum ZIP_COMP compress_method;
+
+	/* Select compression method by the entropy of the first 64KB of input data:
+	  high (already compressed data): ZIP_STORED;
+	  medium: fast ZIP_ZSTANDARD (ZIP_DEFLATED level 1 without zstd);
+	  low: 'compress_method'.
+	Get the selected method with ffzipwrite_method(). */
+	ffuint compress_auto;
+
 	const ffzipwrite_filter *compress_filter;
 	const ffzipwrite_filter *crc32_filter;
+
+	/* Input data is already compressed with 'compress_method' (e.g. by ffzipwrite_compress()).
+	The final sizes and CRC are written to the file header:
+	 no seeking back and no file trailer, even with 'non_seekable'. */
+	ffuint raw;
+	ffuint crc; // CRC32 of uncompressed data
+	ffuint64 uncompressed_size, compressed_size;
+
+	/* 'crc' and 'uncompressed_size' of input data are known in advance (ZIP_STORED only).
+	The final file header is written before the data: no seeking back and no file trailer.
+	The data is verified after it's written. */
+	ffuint size_known;
 } ffzipwrite_conf;
 
 struct ffzipwrite_filter {
@@ -91,6 +138,119 @@ Return 0 on success
   -2 if normalized file name is empty (.e.g. for "/" or "." or "..") */
 static int ffzipwrite_fileadd(ffzipwrite *w, ffzipwrite_conf *conf);
 
+/** Prepare to copy a file from another archive without recompression
+ (its data is read with ffzipread.raw).
+info: file info from CDIR */
+static inline void ffzipwrite_conf_raw(ffzipwrite_conf *conf, const struct zip_fileinfo *info)
+{
+	conf->name = info->name;
+	conf->mtime = info->mtime;
+	conf->attr_win = info->attr_win;
+	conf->attr_unix = info->attr_unix;
+	conf->uid = info->uid;
+	conf->gid = info->gid;
+	conf->compress_method = info->compress_method;
+	conf->raw = 1;
+	conf->crc = info->uncompressed_crc;
+	conf->uncompressed_size = info->uncompressed_size;
+	conf->compressed_size = info->compressed_size;
+}
+
+/** Compress the whole file data in one call.
+Doesn't use any writer object, so several files may be compressed in parallel by worker threads,
+ then added in the needed order with ffzipwrite_fileadd() and the compressed data as input.
+conf: compression method and settings;
+  on return: 'raw', 'crc', 'uncompressed_size', 'compressed_size' are set
+out: (output) compressed data is appended
+Return 0 on success */
+static int ffzipwrite_compress(ffzipwrite_conf *conf, ffstr data, ffvec *out);
+
+/** Key for the compressed data in cache */
+typedef struct ffzipwrite_cache_key {
+	ffbyte hash[32]; // SHA-256 of uncompressed data
+	ffuint64 size; // uncompressed size
+	ffuint method; // enum ZIP_COMP
+	int level; // compression level
+} ffzipwrite_cache_key;
+
+/** Storage for compressed file data (e.g. a local directory or a key-value store) */
+typedef struct ffzipwrite_cache {
+	/** Find the data by key.
+	out: (output) data is appended
+	Return 0 if found */
+	int (*get)(void *opaque, const ffzipwrite_cache_key *key, ffvec *out);
+
+	/** Store the data by key */
+	void (*put)(void *opaque, const ffzipwrite_cache_key *key, ffstr data);
+
+	void *opaque;
+} ffzipwrite_cache;
+
+#define FFZIPWRITE_CACHE_KEY_STR  (64 + 24)
+
+/** Get the file name for the key: FFZIPWRITE_CACHE_KEY_STR hex characters
+Return N of bytes written */
+static inline ffsize ffzipwrite_cache_key_str(const ffzipwrite_cache_key *key, char *buf, ffsize cap)
+{
+	if (cap < 64)
+		return 0;
+	for (ffuint i = 0;  i != 32;  i++) {
+		buf[i*2] = "0123456789abcdef"[key->hash[i] >> 4];
+		buf[i*2+1] = "0123456789abcdef"[key->hash[i] & 0x0f];
+	}
+	ffssize n = ffs_format(buf + 64, cap - 64, "%016xU%04xu%04xu"
+		, key->size, key->method, (ffuint)key->level & 0xffff);
+	if (n <= 0)
+		return 0;
+	return 64 + n;
+}
+
+/** Same as ffzipwrite_compress(), but take the compressed data from cache if the same file data
+ was already compressed with the same method and level.
+On a cache miss, the compressed data is stored to cache.
+Data compressed by a user filter ('compress_filter') isn't cached.
+Return 0 on success;
+  1 on success: the data is taken from cache
+  <0 on error */
+static int ffzipwrite_compress_cached(const ffzipwrite_cache *cache, ffzipwrite_conf *conf, ffstr data, ffvec *out);
+
+/** Compress a part of a large file's data independently of the other parts (e.g. in worker threads).
+The compressed parts are then passed in order as the input for one 'raw' file.
+deflate: the part is primed with the end of the previous part's input data,
+ and all parts except the last end at a byte boundary (sync flush),
+ so that together they form a single deflate stream.
+zstd: each part is an independent frame.
+conf: compression method and settings
+prev: input data preceding this part (only the last 32KB are used); empty for the first part
+last: this is the final part
+out: (output) compressed data is appended
+crc: (output) CRC32 of 'data'; see ffzipwrite_crc32_combine()
+Return 0 on success */
+static int ffzipwrite_compress_part(ffzipwrite_conf *conf, ffstr data, ffstr prev, ffuint last, ffvec *out, ffuint *crc);
+
+/** Get CRC32 of 2 consecutive blocks from CRC32 of each of them
+len2: size of the second block */
+static ffuint ffzipwrite_crc32_combine(ffuint crc1, ffuint crc2, ffuint64 len2);
+
+/** Prepare for adding files to an existing archive.
+The new files are written from the old CDIR offset (FFZIPWRITE_SEEK is returned first),
+ then the old and the new CDIR entries are written.
+After FFZIPWRITE_DONE the caller truncates the output file to ffzipwrite_offset().
+cdir: CDIR data of the existing archive (see ffzipread_cdir())
+cdir_offset: CDIR offset in the existing archive
+Return 0 on success */
+static int ffzipwrite_open_append(ffzipwrite *w, ffstr cdir, ffuint64 cdir_offset);
+
+/** Remove file entry from CDIR (e.g. before adding a new version of this file).
+File data stays in the archive as unused space.
+Not allowed between ffzipwrite_fileadd() and FFZIPWRITE_FILEDONE.
+With 'cdir_spill' the entries already passed to user can't be removed.
+Return 0 on success;
+  -1: not found;
+  -2: a file is being written;
+  -3: not found, but some CDIR segments have been already passed to user */
+static int ffzipwrite_cdir_remove(ffzipwrite *w, ffstr name);
+
 /** Close writer */
 static void ffzipwrite_destroy(ffzipwrite *w);
 
@@ -116,6 +276,14 @@ enum FFZIPWRITE_R {
 
 	/* Fatal error */
 	FFZIPWRITE_ERROR,
+
+	/* (cdir_spill) Output data is a CDIR segment: user must store it (e.g. in a temporary file)
+	Expecting ffzipwrite_process() */
+	FFZIPWRITE_CDIR_SPILL,
+
+	/* (cdir_spill) User must write all stored CDIR segments to the output in order
+	Expecting ffzipwrite_process() */
+	FFZIPWRITE_CDIR_UNSPILL,
 };
 
 #ifdef FFPACK_ZIPWRITE_ZLIB
@@ -130,12 +298,21 @@ output: pointer to an empty string for the output data
 Return enum FFZIPWRITE_R */
 static int ffzipwrite_process(ffzipwrite *w, ffstr *input, ffstr *output);
 
-/** Get output offset */
+/** Get output offset
+After FFZIPWRITE_DONE: the archive size */
 static inline ffuint64 ffzipwrite_offset(ffzipwrite *w)
 {
 	return w->offset;
 }
 
+/** Get compression method of the current file (e.g. selected automatically).
+Compression ratio: file_wr / file_rd after FFZIPWRITE_FILEDONE.
+Return enum ZIP_COMP */
+static inline ffuint ffzipwrite_method(ffzipwrite *w)
+{
+	return w->method;
+}
+
 /** Input data for the current file is finished */
 static inline void ffzipwrite_filefinish(ffzipwrite *w)
 {
@@ -205,6 +382,28 @@ static const ffzipwrite_filter _ffzipw_crc32 = {
 
 
 #define _FFZIPWRITE_BUFCAP  (64*1024)
+#define _FFZIPWRITE_CDIR_SEG  (1*1024*1024)
+
+/** Reserve space in CDIR for a new entry: start a new segment if the current one is full */
+static inline int _ffzipwrite_cdir_reserve(ffzipwrite *w, ffsize n)
+{
+	if (w->cdir.len != 0 && w->cdir.len + n > _FFZIPWRITE_CDIR_SEG) {
+		ffvec *seg = ffvec_pushT(&w->cdir_segs, ffvec);
+		if (seg == NULL)
+			return -1;
+		*seg = w->cdir;
+		w->cdir_segs_size += w->cdir.len;
+		ffvec_null(&w->cdir);
+		if (NULL == ffvec_allocT(&w->cdir, _FFZIPWRITE_CDIR_SEG, char))
+			return -1;
+	}
+
+	if (NULL == ffvec_growtwiceT(&w->cdir, n, char))
+		return -1;
+	return 0;
+}
+
+static int _ffzipwrite_filter_open(ffzipwrite *w, ffzipwrite_conf *conf, ffuint method);
 
 static inline int ffzipwrite_fileadd(ffzipwrite *w, ffzipwrite_conf *conf)
 {
@@ -235,8 +434,25 @@ static inline int ffzipwrite_fileadd(ffzipwrite *w, ffzipwrite_conf *conf)
 	info.gid = conf->gid;
 	if (w->non_seekable)
 		info.compressed_size = (ffuint64)-1;
+	w->file_raw = conf->raw;
+	if (conf->raw) {
+		info.uncompressed_crc = conf->crc;
+		info.uncompressed_size = conf->uncompressed_size;
+		info.compressed_size = conf->compressed_size;
+		w->raw_crc = conf->crc;
+		w->raw_size = conf->uncompressed_size;
+		w->raw_comp_size = conf->compressed_size;
+	}
 
 	comp_method = (dir) ? ZIP_STORED : conf->compress_method;
+	w->file_known = (conf->size_known && !conf->raw && !conf->compress_auto && comp_method == ZIP_STORED);
+	if (w->file_known) {
+		info.uncompressed_crc = conf->crc;
+		info.uncompressed_size = conf->uncompressed_size;
+		info.compressed_size = conf->uncompressed_size;
+		w->raw_crc = conf->crc;
+		w->raw_size = conf->uncompressed_size;
+	}
 	info.compress_method = (enum ZIP_COMP)comp_method;
 	info.hdr_offset = w->total_wr;
 
@@ -252,12 +468,14 @@ static inline int ffzipwrite_fileadd(ffzipwrite *w, ffzipwrite_conf *conf)
 	}
 	w->buf.len = r;
 
-	// we need to update CRC and file sizes after file data is written
+	// we need to update CRC and file sizes after file data is written.
+	// The previous file's header is left here if W_FHDR_UPDATE was skipped (raw, known size, non-seekable).
+	w->fhdr_buf.len = 0;
 	ffvec_add2T(&w->fhdr_buf, &w->buf, char);
 
 	// prepare CDIR entry now and not later, or otherwise we'd have to store values from 'conf'
 	r = zip_cdir_write(NULL, &info, 0);
-	if (NULL == ffvec_growtwiceT(&w->cdir, (ffsize)r, char))
+	if (0 != _ffzipwrite_cdir_reserve(w, r))
 		goto end;
 	r = zip_cdir_write(ffslice_endT(&w->cdir, char), &info, w->timezone_offset);
 	if (r < 0) {
@@ -281,7 +499,35 @@ static inline int ffzipwrite_fileadd(ffzipwrite *w, ffzipwrite_conf *conf)
 		w->filters[1].iface = NULL;
 	}
 
-	switch (comp_method) {
+	w->auto_select = (conf->compress_auto && !conf->raw && !dir);
+	if (w->auto_select) {
+		// the filter is opened after we get the input data
+		ffmem_free(w->auto_conf);
+		if (NULL == (w->auto_conf = ffmem_new(ffzipwrite_conf)))
+			goto end;
+		*w->auto_conf = *conf;
+		ffstr_null(&w->auto_conf->name);
+		w->filter_cur = 0;
+		rc = 0;
+		goto end;
+	}
+
+	if (0 != _ffzipwrite_filter_open(w, conf, (conf->raw) ? ZIP_STORED : comp_method))
+		goto end;
+	w->method = comp_method; // raw data is passed through ZIP_STORED filter
+
+	w->filter_cur = 0;
+	rc = 0;
+
+end:
+	ffstr_free(&name);
+	return rc;
+}
+
+static inline int _ffzipwrite_filter_open(ffzipwrite *w, ffzipwrite_conf *conf, ffuint method)
+{
+	w->method = method;
+	switch (method) {
 
 	case ZIP_STORED:
 		w->filters[1].iface = &_ffzipw_stored;
@@ -306,15 +552,342 @@ static inline int ffzipwrite_fileadd(ffzipwrite *w, ffzipwrite_conf *conf)
 
 	if (NULL == (w->filters[1].obj = w->filters[1].iface->open(w, conf)))
 		return -1;
+	return 0;
+}
 
-	w->filter_cur = 0;
+/** Get 65536*log2(x) (approximately) */
+static inline ffuint _ffzipw_log2_q16(ffuint x)
+{
+	ffuint k = 0;
+	while ((x >> k) > 1) {
+		k++;
+	}
+	ffuint f = (ffuint)(((ffuint64)x << 16) >> k) - 65536; // x/2^k - 1
+	// log2(1+f) ~= f + 0.346*f*(1-f)
+	ffuint c = (ffuint)((((ffuint64)f * (65536 - f)) >> 16) * 22675 >> 16);
+	return (k << 16) + f + c;
+}
+
+/** Get entropy of data (bits per byte * 65536) */
+static inline ffuint _ffzipw_entropy_q16(ffstr d)
+{
+	if (d.len == 0)
+		return 0;
+
+	ffuint cnt[256] = {};
+	for (ffsize i = 0;  i != d.len;  i++) {
+		cnt[(ffbyte)d.ptr[i]]++;
+	}
+
+	// H = log2(n) - sum(c * log2(c)) / n
+	ffuint64 sum = 0;
+	for (ffuint i = 0;  i != 256;  i++) {
+		if (cnt[i] != 0)
+			sum += (ffuint64)cnt[i] * _ffzipw_log2_q16(cnt[i]);
+	}
+	return _ffzipw_log2_q16(d.len) - (ffuint)(sum / d.len);
+}
+
+/** Select compression method and open the filter; update the method in file header and CDIR */
+static inline int _ffzipwrite_auto_select(ffzipwrite *w)
+{
+	ffzipwrite_conf *conf = w->auto_conf;
+	ffuint method = conf->compress_method;
+	ffuint e = _ffzipw_entropy_q16(*(ffstr*)&w->sample);
+	if (w->sample.len == 0 || e >= 75 * 65536 / 10) {
+		method = ZIP_STORED;
+
+	} else if (e >= 65 * 65536 / 10) {
+#ifdef FFPACK_ZIPWRITE_ZSTD
+		method = ZIP_ZSTANDARD;
+		conf->zstd_level = 1;
+#else
+		method = ZIP_DEFLATED;
+		conf->deflate_level = 1;
+#endif
+	}
+
+	if (0 != _ffzipwrite_filter_open(w, conf, method))
+		return -1;
+
+	struct zip_filehdr *h = (struct zip_filehdr*)w->buf.ptr;
+	*(ffushort*)h->comp = ffint_le_cpu16(method);
+	h = (struct zip_filehdr*)w->fhdr_buf.ptr;
+	*(ffushort*)h->comp = ffint_le_cpu16(method);
+	struct zip_cdir *cdir = (struct zip_cdir*)ffslice_endT(&w->cdir, char);
+	*(ffushort*)cdir->comp = ffint_le_cpu16(method);
+	return 0;
+}
+
+static inline ffuint _ffzipwrite_crc(ffzipwrite_conf *conf, ffstr data)
+{
+	if (conf->crc32_filter != NULL) {
+		ffzipwrite w = {};
+		ffstr s;
+		conf->crc32_filter->process(NULL, &w, &data, &s);
+		return w.crc;
+	}
+
+#ifdef FFPACK_ZIPWRITE_CRC32
+	return crc32(data.ptr, data.len, 0);
+#else
+	FF_ASSERT(0);
+	return 0;
+#endif
+}
+
+static inline int _ffzipwrite_compress(ffzipwrite_conf *conf, ffstr data, ffuint crc, ffvec *out)
+{
+	int rc = -1;
+	ffzipwrite w = {};
+	w.file_fin = 1;
+	if (NULL == ffvec_allocT(&w.buf, _FFZIPWRITE_BUFCAP, char))
+		return -1;
+
+	ffuint64 size = data.len;
+	w.crc = crc;
+
+	const ffzipwrite_filter *f;
+	switch (conf->compress_method) {
+	case ZIP_STORED:
+		f = &_ffzipw_stored;  break;
+#ifdef FFPACK_ZIPWRITE_ZLIB
+	case ZIP_DEFLATED:
+		f = &_ffzipw_deflated;  break;
+#endif
+#ifdef FFPACK_ZIPWRITE_ZSTD
+	case ZIP_ZSTANDARD:
+		f = &_ffzipw_zstd;  break;
+#endif
+	default:
+		if (conf->compress_filter == NULL) {
+			ffvec_free(&w.buf);
+			return -1; // unsupported method
+		}
+		f = conf->compress_filter;
+	}
+
+	ffsize n = out->len;
+	void *obj;
+	if (NULL == (obj = f->open(&w, conf)))
+		goto end;
+
+	for (;;) {
+		ffstr output = {};
+		int r = f->process(obj, &w, &data, &output);
+		if (r == 0xa11)
+			break;
+		else if (r != 0 || output.len == 0)
+			goto end; // 0xbad or 0xfeed (unexpected, because the input is finished)
+
+		if (output.len != ffvec_add2T(out, &output, char))
+			goto end;
+	}
+
+	conf->raw = 1;
+	conf->crc = w.crc;
+	conf->uncompressed_size = size;
+	conf->compressed_size = out->len - n;
 	rc = 0;
 
 end:
-	ffstr_free(&name);
+	if (obj != NULL)
+		f->close(obj, &w);
+	ffvec_free(&w.buf);
 	return rc;
 }
 
+static inline int ffzipwrite_compress(ffzipwrite_conf *conf, ffstr data, ffvec *out)
+{
+	return _ffzipwrite_compress(conf, data, _ffzipwrite_crc(conf, data), out);
+}
+
+static inline int ffzipwrite_compress_cached(const ffzipwrite_cache *cache, ffzipwrite_conf *conf, ffstr data, ffvec *out)
+{
+	ffuint crc = _ffzipwrite_crc(conf, data);
+	if (conf->compress_filter != NULL || conf->compress_method == ZIP_STORED)
+		return _ffzipwrite_compress(conf, data, crc, out);
+
+	ffzipwrite_cache_key key = {};
+	ffpack_sha256_calc(data.ptr, data.len, key.hash);
+	key.size = data.len;
+	key.method = conf->compress_method;
+	key.level = (conf->compress_method == ZIP_DEFLATED) ? conf->deflate_level : conf->zstd_level;
+
+	ffsize n = out->len;
+	if (0 == cache->get(cache->opaque, &key, out)) {
+		conf->raw = 1;
+		conf->crc = crc;
+		conf->uncompressed_size = data.len;
+		conf->compressed_size = out->len - n;
+		return 1;
+	}
+	out->len = n; // get() may have added partial data
+
+	if (0 != _ffzipwrite_compress(conf, data, crc, out))
+		return -1;
+
+	ffstr packed = FFSTR_INITN((char*)out->ptr + n, out->len - n);
+	cache->put(cache->opaque, &key, packed);
+	return 0;
+}
+
+static inline int ffzipwrite_compress_part(ffzipwrite_conf *conf, ffstr data, ffstr prev, ffuint last, ffvec *out, ffuint *crc)
+{
+	(void)prev; (void)last;
+#ifdef FFPACK_ZIPWRITE_ZLIB
+	if (conf->compress_method == ZIP_DEFLATED) {
+		*crc = _ffzipwrite_crc(conf, data);
+		return _ffzipw_deflated_part(conf, data, prev, last, out);
+	}
+#endif
+
+	ffzipwrite_conf c = *conf;
+	if (0 != ffzipwrite_compress(&c, data, out))
+		return -1;
+	*crc = c.crc;
+	return 0;
+}
+
+/* GF(2) matrix operations for CRC combination (as in zlib) */
+static inline ffuint _ffzipw_gf2_times(const ffuint *mat, ffuint vec)
+{
+	ffuint sum = 0;
+	for (;  vec != 0;  vec >>= 1, mat++) {
+		if (vec & 1)
+			sum ^= *mat;
+	}
+	return sum;
+}
+
+static inline void _ffzipw_gf2_square(ffuint *square, const ffuint *mat)
+{
+	for (ffuint i = 0;  i != 32;  i++) {
+		square[i] = _ffzipw_gf2_times(mat, mat[i]);
+	}
+}
+
+static inline ffuint ffzipwrite_crc32_combine(ffuint crc1, ffuint crc2, ffuint64 len2)
+{
+	if (len2 == 0)
+		return crc1;
+
+	ffuint even[32], odd[32]; // operators for 2^n zero bits
+
+	// operator for one zero bit
+	odd[0] = 0xedb88320;
+	ffuint row = 1;
+	for (ffuint i = 1;  i != 32;  i++) {
+		odd[i] = row;
+		row <<= 1;
+	}
+
+	_ffzipw_gf2_square(even, odd); // 2 zero bits
+	_ffzipw_gf2_square(odd, even); // 4 zero bits
+
+	// apply len2 zero bytes to crc1
+	for (;;) {
+		_ffzipw_gf2_square(even, odd);
+		if (len2 & 1)
+			crc1 = _ffzipw_gf2_times(even, crc1);
+		len2 >>= 1;
+		if (len2 == 0)
+			break;
+
+		_ffzipw_gf2_square(odd, even);
+		if (len2 & 1)
+			crc1 = _ffzipw_gf2_times(odd, crc1);
+		len2 >>= 1;
+		if (len2 == 0)
+			break;
+	}
+
+	return crc1 ^ crc2;
+}
+
+/** Get the next CDIR entry
+Return entry size
+  <0 on error */
+static inline int _ffzipwrite_cdir_next(ffstr cdir, ffstr *name)
+{
+	struct zip_fileinfo info = {};
+	int r;
+	if (cdir.len < sizeof(struct zip_cdir)
+		|| (r = zip_cdir_read(cdir.ptr, &info, 0)) < 0
+		|| (ffsize)r > cdir.len)
+		return -1;
+
+	const struct zip_cdir *h = (struct zip_cdir*)cdir.ptr;
+	ffstr_set(name, h->filename, ffint_le_cpu16_ptr(h->filenamelen));
+	return r;
+}
+
+static inline int ffzipwrite_open_append(ffzipwrite *w, ffstr cdir, ffuint64 cdir_offset)
+{
+	ffstr d = cdir, name;
+	ffuint n = 0;
+	while (d.len != 0) {
+		int r = _ffzipwrite_cdir_next(d, &name);
+		if (r < 0) {
+			w->error = "bad CDIR entry";
+			return -1;
+		}
+		ffstr_shift(&d, r);
+		n++;
+	}
+
+	if (cdir.len != ffvec_add2T(&w->cdir, &cdir, char))
+		return -1;
+	w->cdir_items = n;
+	w->total_wr = cdir_offset;
+	w->append_seek = 1;
+	return 0;
+}
+
+/** Remove entry from CDIR segment */
+static inline int _ffzipwrite_cdir_seg_remove(ffvec *seg, ffstr name)
+{
+	ffstr d = *(ffstr*)seg, fn;
+	while (d.len != 0) {
+		int r = _ffzipwrite_cdir_next(d, &fn);
+		if (r < 0)
+			break;
+
+		if (ffstr_eq2(&fn, &name)) {
+			ffmem_move(d.ptr, d.ptr + r, d.len - r);
+			seg->len -= r;
+			return r;
+		}
+		ffstr_shift(&d, r);
+	}
+	return -1;
+}
+
+static inline int ffzipwrite_cdir_remove(ffzipwrite *w, ffstr name)
+{
+	int r;
+	if (w->state != 0 || w->buf.len != 0)
+		return -2; // the pending CDIR entry of the current file is past 'cdir.len'
+
+	ffvec *segs = (ffvec*)w->cdir_segs.ptr;
+	ffsize i = (w->cdir_spill) ? w->cdir_seg_out : 0; // skip the segments passed to user
+	for (;  i != w->cdir_segs.len;  i++) {
+		if (0 < (r = _ffzipwrite_cdir_seg_remove(&segs[i], name))) {
+			w->cdir_segs_size -= r;
+			w->cdir_items--;
+			return 0;
+		}
+	}
+
+	if (0 < _ffzipwrite_cdir_seg_remove(&w->cdir, name)) {
+		w->cdir_items--;
+		return 0;
+	}
+	if (w->cdir_spill && w->cdir_seg_out != 0)
+		return -3;
+	return -1;
+}
+
 static inline void ffzipwrite_destroy(ffzipwrite *w)
 {
 	if (w->filters[1].iface != NULL) {
@@ -322,10 +895,33 @@ static inline void ffzipwrite_destroy(ffzipwrite *w)
 		w->filters[1].obj = NULL;
 	}
 	ffvec_free(&w->cdir);
+	ffvec *seg;
+	FFSLICE_WALK(&w->cdir_segs, seg) {
+		ffvec_free(seg);
+	}
+	ffvec_free(&w->cdir_segs);
+	ffvec_free(&w->sample);
+	ffmem_free(w->auto_conf);  w->auto_conf = NULL;
 	ffvec_free(&w->buf);
 	ffvec_free(&w->fhdr_buf);
 }
 
+/** Pass the next full CDIR segment to user
+Return FFZIPWRITE_CDIR_SPILL
+  0: no data */
+static inline int _ffzipwrite_cdir_spill(ffzipwrite *w, ffstr *output)
+{
+	ffvec *segs = (ffvec*)w->cdir_segs.ptr;
+	if (w->cdir_seg_out != 0)
+		ffvec_free(&segs[w->cdir_seg_out - 1]); // the user has stored the previous segment
+	if (w->cdir_seg_out == w->cdir_segs.len)
+		return 0;
+
+	ffstr_set2(output, &segs[w->cdir_seg_out]);
+	w->cdir_seg_out++;
+	return FFZIPWRITE_CDIR_SPILL;
+}
+
 /* .zip write:
 for each new file:
  . write local file header
@@ -334,18 +930,27 @@ for each new file:
  . update CDIR header
  . seek to file header and update it or write file trailer
 . write CDIR data, CDIR zip64 trailer, CDIR zip64 trailer locator and CDIR trailer
+  CDIR data is kept in segments of limited size;
+  full segments may be passed to user before the end (spilled) and written back by user
 */
 static inline int ffzipwrite_process(ffzipwrite *w, ffstr *input, ffstr *output)
 {
 	int r;
 	enum {
-		W_FHDR = 0, W_DATA, W_FHDR_UPDATE, W_END_SEEK, W_FTRL, W_FDONE, W_CDIR, W_DONE,
+		W_FHDR = 0, W_DATA, W_FHDR_UPDATE, W_END_SEEK, W_FTRL, W_FDONE, W_CDIR, W_DONE, W_SAMPLE, W_CDIR_TAIL,
 	};
 
 	for (;;) {
 		switch (w->state) {
 
 		case W_FHDR:
+			if (w->cdir_spill && (r = _ffzipwrite_cdir_spill(w, output)))
+				return r;
+			if (w->append_seek) {
+				w->append_seek = 0;
+				w->offset = w->total_wr;
+				return FFZIPWRITE_SEEK; // seek to the old CDIR
+			}
 			if (w->arc_fin) {
 				w->state = W_CDIR;
 				continue;
@@ -354,6 +959,11 @@ static inline int ffzipwrite_process(ffzipwrite *w, ffstr *input, ffstr *output)
 				w->error = "file info isn't ready";
 				return FFZIPWRITE_ERROR;
 			}
+			if (w->auto_select) {
+				w->sample.len = 0;
+				w->state = W_SAMPLE;
+				continue;
+			}
 			ffstr_set2(output, &w->buf);
 			w->buf.len = 0;
 			w->fhdr_offset = w->total_wr;
@@ -364,30 +974,79 @@ static inline int ffzipwrite_process(ffzipwrite *w, ffstr *input, ffstr *output)
 			w->state = W_DATA;
 			return FFZIPWRITE_DATA; // file header data
 
+		case W_SAMPLE: {
+			ffsize n = ffmin(input->len, _FFZIPWRITE_BUFCAP - w->sample.len);
+			if (n != ffvec_addT(&w->sample, input->ptr, n, char))
+				return FFZIPWRITE_ERROR;
+			ffstr_shift(input, n);
+			if (w->sample.len != _FFZIPWRITE_BUFCAP && !w->file_fin)
+				return FFZIPWRITE_MORE;
+
+			if (0 != _ffzipwrite_auto_select(w))
+				return FFZIPWRITE_ERROR;
+			w->auto_select = 0;
+			ffstr_set2(&w->sample_in, &w->sample);
+			w->sample_pending = 1;
+			w->state = W_FHDR;
+			continue;
+		}
+
 		case W_DATA: {
-			if (w->filter_cur == 0) {
-				w->filters[0].iface->process(w->filters[0].obj, w, input, output);
-				*input = *output;
+			// process the sampled data first, then the user's input
+			ffstr *in = (w->sample_pending) ? &w->sample_in : input;
+
+			if (w->filter_cur == 0 && !w->file_raw) {
+				w->filters[0].iface->process(w->filters[0].obj, w, in, output);
+				*in = *output;
 				w->filter_cur = 1;
 				continue;
 			}
 
-			ffsize rd = input->len;
-			r = w->filters[1].iface->process(w->filters[1].obj, w, input, output);
-			rd -= input->len;
+			ffuint fin = w->file_fin;
+			if (w->sample_pending)
+				w->file_fin = 0;
+			ffsize rd = in->len;
+			r = w->filters[1].iface->process(w->filters[1].obj, w, in, output);
+			w->file_fin = fin;
+			rd -= in->len;
 			w->file_rd += rd;
 			w->total_rd += rd;
 
 			switch (r) {
 			case 0xfeed:
 				w->filter_cur = 0;
+				if (w->sample_pending) {
+					w->sample_pending = 0;
+					continue;
+				}
 				return FFZIPWRITE_MORE;
 
 			case 0xa11:
+				if (w->file_raw) {
+					if (w->file_wr != w->raw_comp_size) {
+						w->error = "raw data size doesn't match compressed_size";
+						return FFZIPWRITE_ERROR;
+					}
+					zip_cdir_finishwrite(ffslice_endT(&w->cdir, char), w->raw_size, w->file_wr, w->raw_crc);
+					w->cdir.len += w->cdir_hdrlen;
+					w->cdir_items++;
+					w->state = W_FDONE;
+					continue;
+				}
+
 				zip_cdir_finishwrite(ffslice_endT(&w->cdir, char), w->file_rd, w->file_wr, w->crc);
 				w->cdir.len += w->cdir_hdrlen;
 				w->cdir_items++;
 
+				if (w->file_known) {
+					if (w->file_rd != w->raw_size || w->crc != w->raw_crc) {
+						w->error = "file data doesn't match the known size and CRC";
+						return FFZIPWRITE_ERROR;
+					}
+					w->state = W_FDONE;
+					continue;
+				}
+
 				if (w->non_seekable) {
 					w->state = W_FTRL;
 					continue;
@@ -435,18 +1094,40 @@ static inline int ffzipwrite_process(ffzipwrite *w, ffstr *input, ffstr *output)
 			return FFZIPWRITE_FILEDONE;
 
 		case W_CDIR: {
+			if (w->cdir_spill) {
+				if ((r = _ffzipwrite_cdir_spill(w, output)))
+					return r;
+				w->state = W_CDIR_TAIL;
+				if (w->cdir_segs.len != 0)
+					return FFZIPWRITE_CDIR_UNSPILL;
+				continue;
+			}
+
+			if (w->cdir_seg_out != w->cdir_segs.len) {
+				ffvec *seg = ffslice_itemT(&w->cdir_segs, w->cdir_seg_out, ffvec);
+				w->cdir_seg_out++;
+				ffstr_set2(output, seg);
+				return FFZIPWRITE_DATA; // CDIR segment
+			}
+			w->state = W_CDIR_TAIL;
+		}
+			// fallthrough
+
+		case W_CDIR_TAIL: {
+			ffuint64 cdir_off = w->total_wr, cdir_size = w->cdir_segs_size + w->cdir.len;
 			r = zip_cdirtrl64_write(NULL, 0, 0, 0);
 			r += zip_cdirtrl64_loc_write(NULL, 0, 0, 0);
 			r += zip_cdirtrl_write(NULL, 0, 0, 0);
 			if (NULL == ffvec_growT(&w->cdir, r, char))
 				return FFZIPWRITE_ERROR;
 
-			ffuint64 zip64_off = w->total_wr + w->cdir.len;
-			w->cdir.len += zip_cdirtrl64_write(ffslice_endT(&w->cdir, char), w->cdir.len, w->total_wr, w->cdir_items);
+			ffuint64 zip64_off = cdir_off + cdir_size;
+			w->cdir.len += zip_cdirtrl64_write(ffslice_endT(&w->cdir, char), cdir_size, cdir_off, w->cdir_items);
 			w->cdir.len += zip_cdirtrl64_loc_write(ffslice_endT(&w->cdir, char), 1, 0, zip64_off);
 			w->cdir.len += zip_cdirtrl_write(ffslice_endT(&w->cdir, char), 0xffffffff, 0xffffffff, 0xffff);
 
 			ffstr_set2(output, &w->cdir);
+			w->offset = cdir_off + w->cdir_segs_size + w->cdir.len;
 			w->state = W_DONE;
 			return FFZIPWRITE_DATA; // the whole CDIR data
 		}
@@ -213,4 +213,83 @@ int lzma_decode(lzma_decoder *dec, const char *data, size_t *len, char *dst, siz
 	return -r;
 }
 
+
+
+struct lzma_encoder {
+	lzma_stream strm;
+	unsigned int done;
+};
+
+int lzma_encode_init(lzma_encoder **penc, const lzma_enc_conf *conf, char *props)
+{
+	int r;
+	lzma_options_lzma opts;
+	unsigned int preset = (conf != NULL && conf->preset != 0) ? conf->preset : 6;
+	if (lzma_lzma_preset(&opts, preset))
+		return -LZMA_OPTIONS_ERROR;
+	if (conf != NULL && conf->dict_size != 0)
+		opts.dict_size = conf->dict_size;
+
+	lzma_filter filters[2] = {
+		{ LZMA_FILTER_LZMA2, &opts },
+		{ LZMA_VLI_UNKNOWN, NULL },
+	};
+
+	uint32_t n;
+	if (LZMA_OK != (r = lzma_properties_size(&n, &filters[0])) || n != 1)
+		return -LZMA_OPTIONS_ERROR;
+	if (LZMA_OK != (r = lzma_properties_encode(&filters[0], (uint8_t*)props)))
+		return -r;
+
+	lzma_encoder *enc;
+	if (NULL == (enc = calloc(1, sizeof(lzma_encoder))))
+		return -LZMA_MEM_ERROR;
+	lzma_stream strm = LZMA_STREAM_INIT;
+	enc->strm = strm;
+	if (LZMA_OK != (r = lzma_raw_encoder(&enc->strm, filters))) {
+		free(enc);
+		return -r;
+	}
+	*penc = enc;
+	return 0;
+}
+
+void lzma_encode_free(lzma_encoder *enc)
+{
+	if (enc == NULL)
+		return;
+	lzma_end(&enc->strm);
+	free(enc);
+}
+
+int lzma_encode(lzma_encoder *enc, const char *data, size_t *len, char *dst, size_t cap, unsigned int flags)
+{
+	if (enc->done) {
+		*len = 0;
+		return LZMA_DONE;
+	}
+
+	enc->strm.next_in = (void*)data;
+	enc->strm.avail_in = *len;
+	enc->strm.next_out = (void*)dst;
+	enc->strm.avail_out = cap;
+	int r = lzma_code(&enc->strm, (flags & LZMA_FFINISH) ? LZMA_FINISH : LZMA_RUN);
+	*len -= enc->strm.avail_in;
+	size_t n = cap - enc->strm.avail_out;
+
+	switch (r) {
+	case LZMA_STREAM_END:
+		enc->done = 1;
+		if (n == 0)
+			return LZMA_DONE;
+		// fallthrough
+
+	case LZMA_OK:
+	case LZMA_BUF_ERROR:
+		return n;
+	}
+
+	return -r;
+}
+
 lzma_ret lzma_stream_decoder_init(lzma_next_coder *next, const lzma_allocator *allocator, uint64_t memlimit, uint32_t flags){}
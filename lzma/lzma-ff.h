@@ -61,6 +61,33 @@ EXP size_t lzma_decode_bufsize(lzma_decoder *dec, size_t in_bufsize);
 Return the number of bytes written;  0 if more data is needed;  enum LZMA_ERR on error. */
 EXP int lzma_decode(lzma_decoder *dec, const char *data, size_t *len, char *dst, size_t cap);
 
+
+
+typedef struct lzma_encoder lzma_encoder;
+
+typedef struct lzma_enc_conf {
+	unsigned int preset; // 1..9;  0:default (6)
+	unsigned int dict_size; // default: set by preset
+} lzma_enc_conf;
+
+enum LZMA_ENC_FLAGS {
+	LZMA_FFINISH = 1,
+};
+
+/** Initialize raw LZMA2 encoder.
+conf: settings (optional)
+props: (output) LZMA2 filter properties (1 byte)
+Return 0 on success. */
+EXP int lzma_encode_init(lzma_encoder **enc, const lzma_enc_conf *conf, char *props);
+
+EXP void lzma_encode_free(lzma_encoder *enc);
+
+/** Encode data.
+flags: enum LZMA_ENC_FLAGS
+Return the number of bytes written;  0 if more data is needed;  LZMA_DONE if all data is flushed (LZMA_FFINISH);
+ enum LZMA_ERR on error. */
+EXP int lzma_encode(lzma_encoder *enc, const char *data, size_t *len, char *dst, size_t cap, unsigned int flags);
+
 #ifdef __cplusplus
 }
 #endif
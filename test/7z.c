@@ -2,6 +2,7 @@
 2021, Simon Zolin */
 
 #include <ffpack/7z-read.h>
+#include <ffpack/7z-write.h>
 #include <test/test.h>
 
 #define fflog(fmt, ...)  (void) printf(fmt "\n", ##__VA_ARGS__)
@@ -109,11 +110,742 @@ end:
 	ff7zread_close(&z);
 }
 
+/** Read the file; return the number of seek requests */
+static ffuint test_7z_read_file(ff7zread *z, const ffvec *buf, const ff7zread_fileinfo *fi)
+{
+	ffstr in = {}, out;
+	ffvec data = {};
+	ffuint nseek = 0;
+	for (;;) {
+		int r = ff7zread_process(z, &in, &out);
+		switch (r) {
+		case FF7ZREAD_SEEK:
+			nseek++;
+			ffstr_set2(&in, buf);
+			ffstr_shift(&in, ff7zread_offset(z));
+			break;
+
+		case FF7ZREAD_DATA:
+			ffvec_add2T(&data, &out, char);
+			break;
+
+		case FF7ZREAD_FILEDONE: {
+			const struct file *f;
+			FF_FOREACH(contents, f) {
+				if (ffstr_eqz(&fi->name, f->name))
+					xseq((ffstr*)&data, f->data);
+			}
+			ffvec_free(&data);
+			return nseek;
+		}
+
+		default:
+			x(0);
+		}
+	}
+}
+
+/** Read files of a solid folder in reverse order */
+void test_7z_read_random(const ffvec *buf, ffsize cache_limit, ffuint pipeline)
+{
+	ffstr in = {}, out;
+	ff7zread z = {};
+	ff7zread_open(&z);
+	z.cache_limit = cache_limit;
+#ifdef FFPACK_7ZREAD_THREADS
+	z.pipeline = pipeline;
+#else
+	(void)pipeline;
+#endif
+	for (;;) {
+		int r = ff7zread_process(&z, &in, &out);
+		if (r == FF7ZREAD_FILEHEADER)
+			break;
+		x(r == FF7ZREAD_MORE || r == FF7ZREAD_SEEK);
+		ffstr_set2(&in, buf);
+		if (r == FF7ZREAD_SEEK)
+			ffstr_shift(&in, ff7zread_offset(&z));
+	}
+
+	const ff7zread_fileinfo *fi;
+	ffuint n = 0;
+	while (NULL != (fi = ff7zread_fileopen(&z, 0, n))) {
+		test_7z_read_file(&z, buf, fi);
+		n++;
+	}
+	x(n >= 2);
+
+	while (n != 0) {
+		n--;
+		fi = ff7zread_fileopen(&z, 0, n);
+		ffuint nseek = test_7z_read_file(&z, buf, fi);
+		if (cache_limit != 0)
+			xieq(0, nseek);
+		else if (n != 0)
+			xieq(1, nseek);
+	}
+
+	ff7zread_close(&z);
+}
+
+/* raw LZMA2 data (dictionary size: 64KB) for "hello LZMA2 chunk data " * 20 */
+static const ffbyte lzma2_data[] = {
+0xe0,0x01,0xcb,0x00,0x20,0x5d,0x00,0x34,0x19,0x49,0xee,0x8d,0xe9,0x0b,0xc9,0x3a,
+0xba,0xe0,0x9e,0xef,0xd2,0xef,0x4a,0xc5,0xab,0xb8,0x6a,0x73,0xc2,0x7d,0xc3,0x64,
+0x2f,0x09,0x4c,0xe2,0x6e,0xe0,0x00,0x00,/*end*/
+};
+
+/** Split LZMA2 data with several dictionary resets and decode the segments independently */
+void test_7z_lzma2_split()
+{
+	ffvec plain = {}, data = {}, segs = {};
+	for (ffuint i = 0;  i != 20 * 2;  i++) {
+		if (i == 20)
+			ffvec_add(&plain, "01234", 5, 1);
+		ffvec_addsz(&plain, "hello LZMA2 chunk data ");
+	}
+
+	// LZMA chunks + uncompressed chunk with dictionary reset + LZMA chunks
+	ffvec_add(&data, lzma2_data, sizeof(lzma2_data) - 1, 1);
+	ffvec_addchar(&data, 0x01);
+	ffvec_addchar(&data, 0x00);
+	ffvec_addchar(&data, 0x04);
+	ffvec_add(&data, "01234", 5, 1);
+	ffvec_add(&data, lzma2_data, sizeof(lzma2_data), 1);
+
+	x(0 == ff7zread_lzma2_split(*(ffstr*)&data, &segs));
+	xieq(3, segs.len);
+
+	ffvec out = {};
+	ffvec_alloc(&out, plain.len, 1);
+	const ff7zread_lzma2_seg_t *sg;
+	FFSLICE_WALK(&segs, sg) {
+		ffstr seg = FFSTR_INITN((char*)data.ptr + sg->off, sg->size);
+		x(0 == ff7zread_lzma2_decode(0x08, seg, (char*)out.ptr + sg->unpacked_off, sg->unpacked_size));
+		out.len += sg->unpacked_size;
+	}
+	xieq(plain.len, out.len);
+	x(!ffmem_cmp(plain.ptr, out.ptr, out.len));
+
+	// LZMA chunks + uncompressed chunks (the first one resets dictionary)
+	//  + LZMA chunk with new properties but without dictionary reset:
+	//  the split point is at the uncompressed chunk.
+	// The LZMA chunk was encoded from the start of dictionary,
+	//  so the uncompressed data is aligned and ends with 0 byte to decode it from here.
+	plain.len = 0;
+	for (ffuint i = 0;  i != 20 * 2;  i++) {
+		if (i == 20)
+			ffvec_add(&plain, "0123abc\0", 8, 1);
+		ffvec_addsz(&plain, "hello LZMA2 chunk data ");
+	}
+	data.len = 0;
+	ffvec_add(&data, lzma2_data, sizeof(lzma2_data) - 1, 1);
+	ffvec_add(&data, "\x01\x00\x03" "0123", 3 + 4, 1);
+	ffvec_add(&data, "\x02\x00\x03" "abc\0", 3 + 4, 1);
+	ffvec_add(&data, lzma2_data, sizeof(lzma2_data), 1);
+	((char*)data.ptr)[sizeof(lzma2_data) - 1 + 7 + 7] = 0xc0;
+
+	x(0 == ff7zread_lzma2_split(*(ffstr*)&data, &segs));
+	xieq(2, segs.len);
+	sg = ffslice_itemT(&segs, 1, ff7zread_lzma2_seg_t);
+	xieq(sizeof(lzma2_data) - 1, sg->off);
+
+	ffvec_free(&out);
+	ffvec_alloc(&out, plain.len, 1);
+	FFSLICE_WALK(&segs, sg) {
+		ffstr seg = FFSTR_INITN((char*)data.ptr + sg->off, sg->size);
+		x(0 == ff7zread_lzma2_decode(0x08, seg, (char*)out.ptr + sg->unpacked_off, sg->unpacked_size));
+		out.len += sg->unpacked_size;
+	}
+	xieq(plain.len, out.len);
+	x(!ffmem_cmp(plain.ptr, out.ptr, out.len));
+
+	ffvec_free(&out);
+	ffvec_free(&segs);
+	ffvec_free(&data);
+	ffvec_free(&plain);
+}
+
+/* Folder: LZMA(jump) + LZMA(call) + LZMA(main) + range coder stream -> BCJ2;
+ 2 files of x86-like code */
+const ffbyte z7data_bcj2[] = {
+0x37,0x7a,0xbc,0xaf,0x27,0x1c,0x00,0x04,0x6c,0x57,0x94,0xca,0xb5,0x02,0x00,0x00,
+0x00,0x00,0x00,0x00,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xbb,0x3c,0x23,0x2c,
+0x00,0x74,0x3a,0x53,0xe5,0x8f,0x70,0x9a,0x39,0x88,0x5e,0x2c,0x59,0x39,0x5a,0xde,
+0x1f,0x49,0xd4,0xc5,0xce,0x67,0x29,0x9e,0x8e,0xba,0xae,0x1f,0x21,0xd6,0x92,0x24,
+0x44,0x95,0xd9,0x10,0x04,0xb6,0x5f,0x5d,0x1b,0xee,0x09,0x8e,0x89,0xf7,0xf7,0x0f,
+0x8d,0x9e,0x39,0x01,0xde,0xf8,0xda,0x84,0xde,0x92,0xb4,0x54,0x08,0xac,0x13,0xe5,
+0x17,0x57,0x5b,0x5c,0x5b,0x7e,0xc3,0x11,0x0f,0x99,0x9d,0x5c,0xaa,0xe5,0xf0,0x97,
+0x73,0xeb,0x56,0x00,0x8e,0x7a,0x86,0x1c,0x95,0xa1,0xa2,0x31,0x8a,0x9a,0xe4,0x23,
+0x26,0x0d,0x80,0x4a,0xac,0x43,0xb8,0xfe,0xe3,0xda,0x49,0x25,0xb0,0xe4,0x5b,0x6a,
+0x35,0xec,0xdd,0x2e,0x91,0xe2,0x78,0x73,0x5f,0xd9,0xdb,0x36,0xce,0xd9,0x82,0xae,
+0xba,0xff,0x9d,0xd3,0x0f,0xb1,0xad,0x81,0xd4,0x8d,0xa3,0xff,0x9c,0x72,0x82,0x46,
+0xe8,0xf0,0x38,0x2c,0x6c,0xde,0xfa,0x0c,0xcb,0x54,0xb8,0x0d,0x43,0xb8,0x08,0x46,
+0xc2,0x9d,0xc2,0xdd,0x5f,0xaf,0x55,0xd3,0xdd,0x5c,0x87,0x7f,0x80,0x46,0x6c,0xc6,
+0x3b,0x74,0x5d,0x04,0x27,0xf1,0xea,0x25,0x41,0x25,0xa1,0x37,0x86,0x74,0x86,0x85,
+0x48,0x46,0x11,0x89,0x01,0x9f,0x69,0xc2,0x64,0xed,0xff,0xd8,0xdc,0x36,0xc7,0x2c,
+0x38,0x6a,0x34,0x3a,0x93,0xb1,0xe1,0xbb,0x09,0x55,0xc3,0x80,0x93,0xd5,0xb3,0xc8,
+0x9d,0x86,0xd6,0x74,0x54,0x28,0x1e,0x09,0x91,0x5b,0x4b,0xea,0x01,0x8d,0xe2,0xc5,
+0x2e,0xd6,0xd9,0x51,0xcb,0xb6,0xed,0xa0,0x1e,0x28,0xe9,0xfc,0x02,0xd5,0x96,0x7f,
+0x4e,0x38,0x6e,0x4b,0x64,0x53,0x13,0x69,0x4d,0x8d,0xba,0x83,0x6f,0x55,0x29,0x6b,
+0x52,0x6f,0x28,0x8a,0xeb,0xf4,0x19,0x8b,0x66,0x0f,0xc3,0xfd,0x2f,0xa6,0xd0,0x53,
+0x55,0x93,0xf9,0x7c,0x39,0xf6,0x48,0xbc,0xc0,0x1a,0x1e,0x6e,0x05,0x08,0x32,0xdd,
+0x2f,0x50,0x26,0x35,0x4f,0x78,0x88,0xb3,0x4b,0xca,0xe7,0x57,0x81,0x20,0x2c,0xd1,
+0x5e,0xec,0x79,0x3f,0xf5,0x2a,0x05,0xca,0xea,0x85,0x94,0x86,0xde,0x6c,0x64,0x1a,
+0x52,0xd8,0xdf,0xd2,0xaa,0xa7,0xb4,0x41,0xac,0xb8,0xf2,0x4b,0x48,0xdd,0x30,0x5f,
+0xe1,0x7a,0x88,0x23,0x2c,0xc5,0x30,0x5e,0x64,0x2c,0x5e,0x59,0xac,0x3b,0x02,0x23,
+0x3c,0x84,0x2b,0xb6,0xe0,0xc0,0x3b,0xe6,0x4f,0x4f,0x27,0x7b,0x51,0xbe,0x36,0x43,
+0x85,0xd6,0xdd,0x34,0xcd,0xc7,0x9a,0x62,0x9e,0xc6,0x96,0x42,0x5c,0xf0,0x32,0x23,
+0xae,0xce,0x10,0xec,0x1e,0x8b,0xcb,0xb1,0x11,0xa9,0xbd,0xb1,0xff,0x5c,0x5e,0xbc,
+0x00,0x00,0xdb,0x4e,0x9c,0xeb,0x54,0x1f,0x3a,0x85,0xe8,0x09,0x24,0x9c,0xe0,0x8b,
+0x05,0xa6,0x91,0x00,0x00,0x00,0x00,0x9f,0xac,0x35,0x74,0x1b,0x20,0x26,0x7d,0x59,
+0x63,0x25,0x4f,0x80,0x59,0xad,0x27,0xff,0x67,0x8b,0x79,0xfb,0x66,0xce,0x8c,0x3a,
+0x72,0x69,0xd2,0xb6,0xa4,0xb0,0xea,0x2a,0xbd,0x54,0x45,0x96,0xcb,0x1f,0x47,0x48,
+0x62,0x18,0x25,0xae,0xf7,0xfe,0x59,0xb4,0xdf,0x39,0x3f,0xa3,0x3c,0xc3,0x04,0xf7,
+0x94,0xf1,0x40,0x5b,0xd6,0xf7,0x27,0x37,0x9e,0x7d,0xe8,0x38,0x54,0x05,0x45,0xd9,
+0x84,0xff,0x27,0x55,0xbd,0xe9,0x74,0x6d,0x78,0x6f,0x9c,0xa6,0xbc,0xec,0x59,0x04,
+0x71,0x84,0x2f,0x76,0x8d,0x38,0x09,0xd1,0x90,0x4e,0xf6,0x20,0xf7,0x93,0x01,0x07,
+0x9b,0x7c,0x37,0xdd,0x95,0x9f,0x7f,0x76,0x1b,0xc0,0xc6,0x19,0x81,0xda,0xab,0xfc,
+0x4e,0x35,0x23,0xf3,0x17,0x9a,0xcf,0xd4,0xda,0x31,0xa1,0x51,0xb8,0xce,0x5b,0xb7,
+0x19,0xb7,0x1b,0xdc,0x5f,0x35,0x8a,0xaf,0x02,0xf3,0x90,0x66,0xcc,0x88,0x7e,0x4c,
+0xbf,0xff,0xf2,0x51,0xdc,0x00,0x00,0x00,0x68,0x04,0x7f,0xe0,0xb6,0x28,0xa0,0x04,
+0x66,0x96,0xd5,0xbb,0x3b,0x1f,0x64,0x12,0xfd,0xa6,0x30,0xc9,0xe5,0xad,0x36,0x04,
+0xfe,0x7a,0xf7,0x51,0x45,0xb1,0x1e,0x73,0x07,0xfb,0xed,0x63,0x4f,0xd7,0xcb,0x58,
+0x54,0x8b,0x8f,0x8d,0xa9,0x14,0x5c,0xdd,0x0d,0x73,0x23,0x01,0xaf,0x81,0x18,0xdf,
+0xea,0xc8,0x0f,0xbf,0xa9,0x7f,0x32,0xf7,0xa0,0xcf,0xbb,0xef,0x90,0xec,0x9f,0x83,
+0xf0,0x0b,0xda,0x2c,0xcc,0xbd,0xee,0x5f,0xfc,0x2f,0x8d,0xfa,0x28,0x3d,0xc9,0x2f,
+0xe3,0xfc,0x67,0x5e,0x00,0x01,0x04,0x06,0x00,0x04,0x09,0x81,0xa1,0x13,0x80,0xa2,
+0x5f,0x00,0x07,0x0b,0x01,0x00,0x04,0x23,0x03,0x01,0x01,0x05,0x5d,0x00,0x00,0x01,
+0x00,0x23,0x03,0x01,0x01,0x05,0x5d,0x00,0x00,0x01,0x00,0x23,0x03,0x01,0x01,0x05,
+0x5d,0x00,0x00,0x01,0x00,0x14,0x03,0x03,0x01,0x1b,0x04,0x01,0x05,0x00,0x04,0x01,
+0x03,0x02,0x02,0x06,0x01,0x00,0x0c,0x80,0x80,0x80,0xb0,0x81,0xd2,0x83,0x02,0x00,
+0x08,0x0d,0x02,0x09,0x81,0x81,0x0a,0x01,0x6e,0x6a,0x42,0x55,0x0b,0x99,0x24,0x4a,
+0x00,0x00,0x05,0x02,0x11,0x1d,0x00,0x62,0x00,0x63,0x00,0x6a,0x00,0x32,0x00,0x2d,
+0x00,0x31,0x00,0x00,0x00,0x62,0x00,0x63,0x00,0x6a,0x00,0x32,0x00,0x2d,0x00,0x32,
+0x00,0x00,0x00,0x00,0x00,
+};
+
+/** Read BCJ2 folder, giving the input data by small chunks */
+void test_7z_read_bcj2(ffsize chunk)
+{
+	ffstr in = {}, out;
+	ffuint64 off = 0;
+	ffvec data = {};
+	const ff7zread_fileinfo *fi = NULL;
+	ffuint nfiles = 0;
+	ff7zread z = {};
+	ff7zread_open(&z);
+
+	for (;;) {
+		int r = ff7zread_process(&z, &in, &out);
+		switch (r) {
+		case FF7ZREAD_SEEK:
+			off = ff7zread_offset(&z);
+			// fallthrough
+
+		case FF7ZREAD_MORE:
+			x(off < sizeof(z7data_bcj2));
+			ffstr_set(&in, z7data_bcj2 + off, ffmin(chunk, sizeof(z7data_bcj2) - off));
+			off += in.len;
+			break;
+
+		case FF7ZREAD_FILEHEADER:
+			if (NULL == (fi = ff7zread_nextfile(&z)))
+				goto end;
+			break;
+
+		case FF7ZREAD_DATA:
+			ffvec_add2T(&data, &out, char);
+			break;
+
+		case FF7ZREAD_FILEDONE:
+			xieq(fi->size, data.len);
+			xieq(fi->crc, crc32(data.ptr, data.len, 0));
+			x(ffstr_eqz(&fi->name, (nfiles == 0) ? "bcj2-1" : "bcj2-2"));
+			data.len = 0;
+			nfiles++;
+			break;
+
+		default:
+			fflog("error: %s", ff7zread_error(&z));
+			x(0);
+		}
+	}
+
+end:
+	xieq(2, nfiles);
+	ffvec_free(&data);
+	ff7zread_close(&z);
+}
+
+/** Extract files by name */
+void test_7z_read_select(const ffvec *buf)
+{
+	ffstr in = {}, out;
+	ff7zread z = {};
+	ff7zread_open(&z);
+	for (;;) {
+		int r = ff7zread_process(&z, &in, &out);
+		if (r == FF7ZREAD_FILEHEADER)
+			break;
+		x(r == FF7ZREAD_MORE || r == FF7ZREAD_SEEK);
+		ffstr_set2(&in, buf);
+		if (r == FF7ZREAD_SEEK)
+			ffstr_shift(&in, ff7zread_offset(&z));
+	}
+
+	ffstr name;
+	ffstr_setz(&name, "no-such-file");
+	xieq(-1, ff7zread_find(&z, name));
+
+	for (ffsize i = FF_COUNT(contents);  i != 0;  i--) {
+		ffstr_setz(&name, contents[i - 1].name);
+		ffssize idx = ff7zread_find(&z, name);
+		x(idx >= 0);
+		const ff7zread_fileinfo *fi = ff7zread_select(&z, idx);
+		x(fi != NULL);
+		xseq(&fi->name, contents[i - 1].name);
+		test_7z_read_file(&z, buf, fi);
+	}
+	x(NULL == ff7zread_select(&z, FF_COUNT(contents)));
+
+	ff7zread_close(&z);
+}
+
+/** Extract each folder with a separate reader */
+void test_7z_read_folders(const ffvec *buf)
+{
+	ffstr in = {}, out;
+	ff7zread z = {};
+	ff7zread_open(&z);
+	for (;;) {
+		int r = ff7zread_process(&z, &in, &out);
+		if (r == FF7ZREAD_FILEHEADER)
+			break;
+		x(r == FF7ZREAD_MORE || r == FF7ZREAD_SEEK);
+		ffstr_set2(&in, buf);
+		if (r == FF7ZREAD_SEEK)
+			ffstr_shift(&in, ff7zread_offset(&z));
+	}
+
+	ffvec order = {};
+	x(0 == ff7zread_folders_order(&z, &order));
+	xieq(ff7zread_folders(&z), order.len);
+
+	ffuint nfiles = 0;
+	ffvec uncomp = {};
+	const ff7zread_fileinfo *fi = NULL;
+	const ffuint *pi;
+	FFSLICE_WALK(&order, pi) {
+		ff7zread zf;
+		x(0 == ff7zread_open_folder(&zf, &z, *pi));
+		ffstr_null(&in);
+		for (;;) {
+			int r = ff7zread_process(&zf, &in, &out);
+			switch (r) {
+			case FF7ZREAD_MORE:
+				x(0);
+				break;
+
+			case FF7ZREAD_SEEK:
+				ffstr_set2(&in, buf);
+				ffstr_shift(&in, ff7zread_offset(&zf));
+				break;
+
+			case FF7ZREAD_FILEHEADER:
+				if (NULL == (fi = ff7zread_nextfile(&zf)))
+					goto next;
+				break;
+
+			case FF7ZREAD_DATA:
+				ffvec_add2T(&uncomp, &out, char);
+				break;
+
+			case FF7ZREAD_FILEDONE: {
+				const struct file *f;
+				FF_FOREACH(contents, f) {
+					if (ffstr_eqz(&fi->name, f->name)) {
+						xseq((ffstr*)&uncomp, f->data);
+						nfiles++;
+					}
+				}
+				uncomp.len = 0;
+				break;
+			}
+
+			default:
+				x(0);
+			}
+		}
+next:
+		ff7zread_close(&zf);
+	}
+	xieq(FF_COUNT(contents), nfiles);
+
+	ffvec_free(&uncomp);
+	ffvec_free(&order);
+	ff7zread_close(&z);
+}
+
+static char big_data[2][100*1024 + 1];
+
+static struct file wcontents[] = {
+	{ "dir/dirfile", 0x20, "data-dirfile" },
+	{ "dir/file2", 0x20, "data-file2" },
+	{ "dir", 0x10, "" },
+	{ "empty-file", 0x20, "" },
+	{ "file.txt", 0x20, "data-file" },
+	{ "big.txt", 0x20, big_data[0] },
+	{ "big2.txt", 0x20, big_data[1] }, // exceeds 'solid_size'
+	{ "blk/1.bin", 0x20, "block-data-1" }, // added as a block
+	{ "blk/empty", 0x20, "" },
+	{ "blk/2.bin", 0x20, "block-data-2" },
+};
+
+/** Write output data at the current offset */
+static void test_7z_write_data(ffvec *buf, ffuint64 *off, ffstr out)
+{
+	ffvec_grow(buf, *off + out.len, 1);
+	ffmem_copy((char*)buf->ptr + *off, out.ptr, out.len);
+	*off += out.len;
+	buf->len = ffmax(buf->len, *off);
+}
+
+/** Write .7z with solid blocks, empty files and a block compressed separately */
+static void test_7z_write_arc(ffvec *buf, ffuint method, ffuint block_method)
+{
+	ffstr in, out;
+	ffuint64 off = 0;
+	ffsize i = 0, iblk = 7;
+
+	ff7zwrite_block blk;
+	ff7zwrite_coder_conf bconf = {};
+	bconf.method = block_method;
+	ffstr bdata[3];
+	ff7zwrite_conf bconfs[3] = {};
+	for (ffsize k = 0;  k != 3;  k++) {
+		ffstr_setz(&bdata[k], wcontents[iblk + k].data);
+		ffstr_setz(&bconfs[k].name, wcontents[iblk + k].name);
+		bconfs[k].attr = wcontents[iblk + k].attr;
+		bconfs[k].mtime.sec = 1600000000;
+	}
+	x(0 == ff7zwrite_block_compress(&bconf, bdata, 3, &blk));
+
+	ff7zwrite w = {};
+	w.coder.method = method;
+	w.solid_ext = 1;
+	w.solid_size = 64*1024;
+
+	ff7zwrite_conf conf = {};
+	ffstr_setz(&conf.name, wcontents[0].name);
+	conf.attr = wcontents[0].attr;
+	conf.mtime.sec = 1600000000;
+	x(0 == ff7zwrite_fileadd(&w, &conf));
+	ffstr_setz(&in, wcontents[0].data);
+
+	for (;;) {
+		int r = ff7zwrite_process(&w, &in, &out);
+		switch (r) {
+		case FF7ZWRITE_MORE:
+			ff7zwrite_filefinish(&w);
+			break;
+
+		case FF7ZWRITE_DATA:
+			test_7z_write_data(buf, &off, out);
+			break;
+
+		case FF7ZWRITE_SEEK:
+			off = ff7zwrite_offset(&w);
+			break;
+
+		case FF7ZWRITE_FILEDONE:
+			if (i == iblk)
+				i += 3;
+			else
+				i++;
+			if (i == iblk) {
+				x(0 == ff7zwrite_block_add(&w, bconfs, 3, &blk));
+				break;
+			}
+			if (i == FF_COUNT(wcontents)) {
+				ff7zwrite_finish(&w);
+				break;
+			}
+			ffstr_setz(&conf.name, wcontents[i].name);
+			conf.attr = wcontents[i].attr;
+			x(0 == ff7zwrite_fileadd(&w, &conf));
+			ffstr_setz(&in, wcontents[i].data);
+			break;
+
+		case FF7ZWRITE_DONE:
+			xieq(buf->len, ff7zwrite_offset(&w));
+			goto end;
+
+		default:
+			fflog("error: %s", ff7zwrite_error(&w));
+			x(0);
+		}
+	}
+
+end:
+	ff7zwrite_destroy(&w);
+	ff7zwrite_block_free(&blk);
+}
+
+void test_7z_write(ffuint method, ffuint block_method, ffuint pipeline)
+{
+	for (ffsize k = 0;  k != 2;  k++) {
+		for (ffsize i = 0;  i != sizeof(big_data[k]) - 1;  i++) {
+			big_data[k][i] = "0123456789abcdef"[(i * (k + 1) / 7) % 16];
+		}
+	}
+
+	ffvec buf = {};
+	test_7z_write_arc(&buf, method, block_method);
+
+	ffstr in = {}, out;
+	ffvec data = {};
+	const ff7zread_fileinfo *fi = NULL;
+	const struct file *f = NULL;
+	ffuint nfiles = 0;
+	ff7zread z = {};
+	z.log = z7log;
+	ff7zread_open(&z);
+#ifdef FFPACK_7ZREAD_THREADS
+	z.pipeline = pipeline;
+#else
+	(void)pipeline;
+#endif
+	for (;;) {
+		int r = ff7zread_process(&z, &in, &out);
+		switch (r) {
+		case FF7ZREAD_MORE:
+		case FF7ZREAD_SEEK:
+			ffstr_set2(&in, &buf);
+			if (r == FF7ZREAD_SEEK)
+				ffstr_shift(&in, ff7zread_offset(&z));
+			break;
+
+		case FF7ZREAD_FILEHEADER:
+			if (nfiles == 0) {
+				// dir/ + file.txt,big.txt + big2.txt + blk/ + empty files
+				xieq(5, ff7zread_folders(&z));
+			}
+			if (NULL == (fi = ff7zread_nextfile(&z)))
+				goto end;
+			f = NULL;
+			for (ffsize i = 0;  i != FF_COUNT(wcontents);  i++) {
+				if (ffstr_eqz(&fi->name, wcontents[i].name))
+					f = &wcontents[i];
+			}
+			x(f != NULL);
+			xieq(fi->attr, f->attr);
+			xieq(fi->size, ffsz_len(f->data));
+			xieq(fi->mtime.sec, 1600000000);
+			nfiles++;
+			break;
+
+		case FF7ZREAD_DATA:
+			ffvec_add2T(&data, &out, char);
+			break;
+
+		case FF7ZREAD_FILEDONE:
+			x(ffstr_eqz((ffstr*)&data, f->data));
+			data.len = 0;
+			break;
+
+		default:
+			fflog("error: %s", ff7zread_error(&z));
+			x(0);
+		}
+	}
+
+end:
+	xieq(FF_COUNT(wcontents), nfiles);
+	ffvec_free(&data);
+	ff7zread_close(&z);
+	ffvec_free(&buf);
+}
+
+/** Archive without file data (only a directory and an empty file): header has no MainStreamsInfo */
+void test_7z_write_empty()
+{
+	static const struct file econtents[] = {
+		{ "dir", 0x10, "" },
+		{ "empty-file", 0x20, "" },
+	};
+	ffvec buf = {};
+	ffstr in = {}, out;
+	ffsize i = 0;
+	ffuint64 off = 0;
+
+	ff7zwrite w = {};
+	w.coder.method = Z7_M_LZMA2;
+	ff7zwrite_conf conf = {};
+	ffstr_setz(&conf.name, econtents[0].name);
+	conf.attr = econtents[0].attr;
+	x(0 == ff7zwrite_fileadd(&w, &conf));
+
+	for (;;) {
+		int r = ff7zwrite_process(&w, &in, &out);
+		if (r == FF7ZWRITE_MORE) {
+			ff7zwrite_filefinish(&w);
+		} else if (r == FF7ZWRITE_DATA) {
+			test_7z_write_data(&buf, &off, out);
+		} else if (r == FF7ZWRITE_SEEK) {
+			off = ff7zwrite_offset(&w);
+		} else if (r == FF7ZWRITE_FILEDONE) {
+			if (++i == FF_COUNT(econtents)) {
+				ff7zwrite_finish(&w);
+				continue;
+			}
+			ffstr_setz(&conf.name, econtents[i].name);
+			conf.attr = econtents[i].attr;
+			x(0 == ff7zwrite_fileadd(&w, &conf));
+		} else if (r == FF7ZWRITE_DONE) {
+			break;
+		} else {
+			fflog("error: %s", ff7zwrite_error(&w));
+			x(0);
+		}
+	}
+	ff7zwrite_destroy(&w);
+
+	ff7zread z = {};
+	z.log = z7log;
+	ff7zread_open(&z);
+	ffstr_null(&in);
+	for (;;) {
+		int r = ff7zread_process(&z, &in, &out);
+		if (r == FF7ZREAD_FILEHEADER)
+			break;
+		if (r != FF7ZREAD_MORE && r != FF7ZREAD_SEEK)
+			fflog("error: %s", ff7zread_error(&z));
+		x(r == FF7ZREAD_MORE || r == FF7ZREAD_SEEK);
+		ffstr_set2(&in, &buf);
+		if (r == FF7ZREAD_SEEK)
+			ffstr_shift(&in, ff7zread_offset(&z));
+	}
+
+	const ff7zread_fileinfo *fi;
+	for (i = 0;  NULL != (fi = ff7zread_nextfile(&z));  i++) {
+		xseq(&fi->name, econtents[i].name);
+		xieq(fi->attr, econtents[i].attr);
+		xieq(0, fi->size);
+		x(FF7ZREAD_FILEDONE == ff7zread_process(&z, &in, &out));
+	}
+	xieq(FF_COUNT(econtents), i);
+
+	ff7zread_close(&z);
+	ffvec_free(&buf);
+}
+
+static ffsize test_7z_many_name(char *name, ffsize cap, ffsize i)
+{
+	ffsize n = ffs_format(name, cap - 1, "dir%u/file%u", (ffuint)i % 10, (ffuint)i);
+	name[n] = '\0';
+	return n;
+}
+
+/** Archive with many files: the names are stored in one memory region */
+void test_7z_read_many()
+{
+	enum { N = 3000 };
+	ffvec buf = {};
+	ffstr in, out;
+	ffsize i = 0;
+	ffuint64 off = 0;
+	char name[64];
+
+	ff7zwrite w = {};
+	w.coder.method = Z7_M_STORE;
+	w.solid_size = 16*1024;
+	ff7zwrite_conf conf = {};
+	conf.name.ptr = name;
+	conf.name.len = test_7z_many_name(name, sizeof(name), i);
+	conf.attr = 0x20;
+	x(0 == ff7zwrite_fileadd(&w, &conf));
+	ffstr_setz(&in, name);
+
+	for (;;) {
+		int r = ff7zwrite_process(&w, &in, &out);
+		if (r == FF7ZWRITE_MORE) {
+			ff7zwrite_filefinish(&w);
+		} else if (r == FF7ZWRITE_DATA) {
+			test_7z_write_data(&buf, &off, out);
+		} else if (r == FF7ZWRITE_SEEK) {
+			off = ff7zwrite_offset(&w);
+		} else if (r == FF7ZWRITE_FILEDONE) {
+			if (++i == N) {
+				ff7zwrite_finish(&w);
+				continue;
+			}
+			conf.name.len = test_7z_many_name(name, sizeof(name), i);
+			x(0 == ff7zwrite_fileadd(&w, &conf));
+			ffstr_setz(&in, name);
+		} else if (r == FF7ZWRITE_DONE) {
+			break;
+		} else {
+			x(0);
+		}
+	}
+	ff7zwrite_destroy(&w);
+
+	ff7zread z = {};
+	ff7zread_open(&z);
+	ffstr_null(&in);
+	for (;;) {
+		int r = ff7zread_process(&z, &in, &out);
+		if (r == FF7ZREAD_FILEHEADER)
+			break;
+		x(r == FF7ZREAD_MORE || r == FF7ZREAD_SEEK);
+		ffstr_set2(&in, &buf);
+		if (r == FF7ZREAD_SEEK)
+			ffstr_shift(&in, ff7zread_offset(&z));
+	}
+	x(ff7zread_folders(&z) > 1);
+	x(z.buf.cap == 0); // the unpacked header is released
+
+	const ff7zread_fileinfo *fi;
+	for (i = 0;  NULL != (fi = ff7zread_nextfile(&z));  i++) {
+		conf.name.len = test_7z_many_name(name, sizeof(name), i);
+		xseq(&fi->name, name);
+		xieq(fi->size, conf.name.len);
+		if (i % 500 == 0) {
+			x(i == (ffsize)ff7zread_find(&z, conf.name));
+			test_7z_read_file(&z, &buf, fi);
+		}
+	}
+	xieq(N, i);
+
+	ff7zread_close(&z);
+	ffvec_free(&buf);
+}
+
 void test_7z()
 {
 	ffvec buf = {};
 	ffvec_alloc(&buf, 4096, 1);
 	ffvec_addT(&buf, z7data, sizeof(z7data), char);
 	test_7z_read(&buf);
+	test_7z_read_folders(&buf);
+	test_7z_read_random(&buf, 0, 0);
+	test_7z_read_random(&buf, 1024*1024, 0);
+	test_7z_read_select(&buf);
+	test_7z_lzma2_split();
+	test_7z_read_bcj2(16);
+	test_7z_read_bcj2(64*1024);
+	ffvec_free(&buf);
+	test_7z_write(Z7_M_LZMA2, Z7_M_STORE, 0);
+	test_7z_write(Z7_M_ZSTD, Z7_M_ZSTD, 0);
+	test_7z_write_empty();
+	test_7z_read_many();
+
+#ifdef FFPACK_7ZREAD_THREADS
+	ffvec_addT(&buf, z7data, sizeof(z7data), char);
+	test_7z_read_random(&buf, 0, 1);
+	test_7z_read_random(&buf, 1024*1024, 1);
 	ffvec_free(&buf);
+	test_7z_write(Z7_M_LZMA2, Z7_M_ZSTD, 1);
+#endif
 }
@@ -176,6 +176,63 @@ done:
 	ffvec_free(&uncomp);
 }
 
+/** List the archive skipping file data
+mid: skip after the first chunk of data, input is passed by 1 byte */
+void test_tar_read_skip(const ffvec *buf, int mid)
+{
+	int ifile = 0, nseek = 0;
+	fftarread r = {};
+	x(0 == fftarread_open(&r));
+	ffstr in, out;
+	ffstr_set(&in, buf->ptr, 0);
+
+	for (;;) {
+		int rc = fftarread_process(&r, &in, &out);
+
+		switch (rc) {
+		case FFTARREAD_MORE:
+			x(in.ptr != ffslice_endT(buf, char));
+			in.len = (mid) ? 1 : (char*)buf->ptr + buf->len - in.ptr;
+			break;
+
+		case FFTARREAD_SEEK:
+			nseek++;
+			x(fftarread_offset(&r) % 512 == 0);
+			ffstr_set(&in, (char*)buf->ptr + fftarread_offset(&r), 0);
+			break;
+
+		case FFTARREAD_FILEHEADER:
+			xseq(&fftarread_fileinfo(&r)->name, members[ifile].name);
+			ifile++;
+			if (!mid)
+				fftarread_skip(&r);
+			break;
+
+		case FFTARREAD_DATA:
+			x(mid);
+			xseq(&out, "p");
+			fftarread_skip(&r);
+			break;
+
+		case FFTARREAD_FILEDONE:
+			xieq(0, members[ifile - 1].osize);
+			break;
+
+		case FFTARREAD_DONE:
+			x(ifile == FF_COUNT(members));
+			goto done;
+
+		default:
+			fflog("error: %s", fftarread_error(&r));
+			x(0);
+		}
+	}
+
+done:
+	xieq(1, nseek);
+	fftarread_close(&r);
+}
+
 void test_tar()
 {
 	ffvec buf = {};
@@ -194,6 +251,8 @@ void test_tar()
 #endif
 
 	test_tar_read(&buf);
+	test_tar_read_skip(&buf, 0);
+	test_tar_read_skip(&buf, 1);
 	buf.len = 0;
 
 	ffvec_free(&buf);
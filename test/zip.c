@@ -122,6 +122,575 @@ done:
 	ffzipwrite_destroy(&w);
 }
 
+/** Compress the files separately (as worker threads would do), then write them in order */
+void test_zip_write_raw(ffvec *buf, ffuint non_seekable)
+{
+	ffzipwrite_conf confs[FF_COUNT(members)] = {};
+	ffvec packed[FF_COUNT(members)] = {};
+
+	// unsupported method without a user filter
+	ffzipwrite_conf cu = {};
+	cu.compress_method = 0xffff;
+	x(-1 == ffzipwrite_compress(&cu, FFSTR_Z("plain data"), &packed[0]));
+	xieq(0, packed[0].len);
+
+	for (ffuint i = 0;  i != FF_COUNT(members);  i++) {
+		const struct member *m = &members[i];
+		ffzipwrite_conf *conf = &confs[i];
+		ffstr_setz(&conf->name, m->name);
+		conf->mtime.sec = m->mtime;
+		conf->attr_win = m->attr_win;
+		conf->attr_unix = m->attr_unix;
+		conf->compress_method = m->compress_method;
+		conf->uid = m->uid;
+		conf->gid = m->gid;
+
+		ffstr data = {};
+		if (m->osize != 0)
+			ffstr_setz(&data, "plain data");
+		x(0 == ffzipwrite_compress(conf, data, &packed[i]));
+		x(conf->raw);
+		xieq(m->osize, conf->uncompressed_size);
+		xieq(packed[i].len, conf->compressed_size);
+	}
+
+	ffzipwrite w = {};
+	w.non_seekable = non_seekable;
+	ffuint ifile = 0;
+	ffstr in = {}, out;
+	x(0 == ffzipwrite_fileadd(&w, &confs[0]));
+	for (;;) {
+		int r = ffzipwrite_process(&w, &in, &out);
+		switch (r) {
+		case FFZIPWRITE_DATA:
+			ffvec_add2T(buf, &out, char);
+			break;
+
+		case FFZIPWRITE_MORE:
+			x(in.len == 0);
+			if (!w.file_fin && packed[ifile].len != 0) {
+				ffstr_set2(&in, &packed[ifile]);
+				packed[ifile].len = 0;
+			} else {
+				ffzipwrite_filefinish(&w);
+			}
+			break;
+
+		case FFZIPWRITE_FILEDONE:
+			if (++ifile == FF_COUNT(members)) {
+				ffzipwrite_finish(&w);
+				break;
+			}
+			x(0 == ffzipwrite_fileadd(&w, &confs[ifile]));
+			break;
+
+		case FFZIPWRITE_DONE:
+			goto done;
+
+		default: // no seeking
+			fflog("error: %s", ffzipwrite_error(&w));
+			x(0);
+		}
+	}
+
+done:
+	for (ffuint i = 0;  i != FF_COUNT(members);  i++) {
+		ffvec_free(&packed[i]);
+	}
+	ffzipwrite_destroy(&w);
+}
+
+/** Write raw (already compressed) entries mixed with normal entries in seekable mode
+known: write "file-stored" with known size and CRC instead of raw entries */
+void test_zip_write_mixed(ffvec *buf, ffuint known)
+{
+	ffuint normal[FF_COUNT(members)] = {};
+	ffzipwrite_conf confs[FF_COUNT(members)] = {};
+	ffvec packed[FF_COUNT(members)] = {};
+	ffstr plain = {};
+	for (ffuint i = 0;  i != FF_COUNT(members);  i++) {
+		const struct member *m = &members[i];
+		ffzipwrite_conf *conf = &confs[i];
+		ffstr_setz(&conf->name, m->name);
+		conf->mtime.sec = m->mtime;
+		conf->attr_win = m->attr_win;
+		conf->attr_unix = m->attr_unix;
+		conf->compress_method = m->compress_method;
+		conf->uid = m->uid;
+		conf->gid = m->gid;
+
+		ffstr data = {};
+		if (m->osize != 0)
+			ffstr_setz(&data, "plain data");
+		if (known && i == 2) {
+			conf->size_known = 1;
+			conf->crc = crc32(data.ptr, data.len, 0);
+			conf->uncompressed_size = data.len;
+		} else if (!known && i % 2 == 0) {
+			x(0 == ffzipwrite_compress(conf, data, &packed[i]));
+			continue;
+		} else {
+			normal[i] = 1;
+		}
+		if (m->osize != 0)
+			ffvec_add2T(&packed[i], &data, char);
+	}
+
+	ffzipwrite w = {};
+	ffuint ifile = 0;
+	ffsize off = 0;
+	ffstr out;
+	x(0 == ffzipwrite_fileadd(&w, &confs[0]));
+	for (;;) {
+		int r = ffzipwrite_process(&w, &plain, &out);
+		switch (r) {
+		case FFZIPWRITE_DATA:
+			if (off == buf->len)
+				ffvec_add2T(buf, &out, char);
+			else
+				ffmem_copy((char*)buf->ptr + off, out.ptr, out.len);
+			off += out.len;
+			break;
+
+		case FFZIPWRITE_SEEK:
+			x(normal[ifile]);
+			off = ffzipwrite_offset(&w);
+			break;
+
+		case FFZIPWRITE_MORE:
+			if (!w.file_fin && packed[ifile].len != 0) {
+				ffstr_set2(&plain, &packed[ifile]);
+				packed[ifile].len = 0;
+			} else {
+				ffzipwrite_filefinish(&w);
+			}
+			break;
+
+		case FFZIPWRITE_FILEDONE:
+			if (++ifile == FF_COUNT(members)) {
+				ffzipwrite_finish(&w);
+				break;
+			}
+			x(0 == ffzipwrite_fileadd(&w, &confs[ifile]));
+			break;
+
+		case FFZIPWRITE_DONE:
+			goto done;
+
+		default:
+			fflog("error: %s", ffzipwrite_error(&w));
+			x(0);
+		}
+	}
+
+done:
+	for (ffuint i = 0;  i != FF_COUNT(members);  i++) {
+		ffvec_free(&packed[i]);
+	}
+	ffzipwrite_destroy(&w);
+}
+
+/** Compress a file in 3 parts, write it as a single entry and read it back */
+void test_zip_parts(ffuint method)
+{
+	ffvec plain = {};
+	for (ffuint i = 0;  plain.len < 100*1024;  i++) {
+		ffvec_addfmt(&plain, "line %u: %u\n", i, i * 7919 % 1000);
+	}
+
+	ffzipwrite_conf conf = {};
+	ffstr_setz(&conf.name, "large");
+	conf.compress_method = method;
+	ffvec packed = {};
+	ffsize part = plain.len / 3;
+	ffuint crc = 0;
+	for (ffuint i = 0;  i != 3;  i++) {
+		ffstr d, prev;
+		ffstr_set(&prev, plain.ptr, part * i);
+		ffstr_set(&d, (char*)plain.ptr + part * i, (i != 2) ? part : plain.len - part * 2);
+		ffuint part_crc;
+		x(0 == ffzipwrite_compress_part(&conf, d, prev, (i == 2), &packed, &part_crc));
+		crc = (i == 0) ? part_crc : ffzipwrite_crc32_combine(crc, part_crc, d.len);
+	}
+	xieq(crc32(plain.ptr, plain.len, 0), crc);
+	x(packed.len < plain.len / 2);
+
+	conf.raw = 1;
+	conf.crc = crc;
+	conf.uncompressed_size = plain.len;
+	conf.compressed_size = packed.len;
+
+	ffvec buf = {};
+	ffzipwrite w = {};
+	x(0 == ffzipwrite_fileadd(&w, &conf));
+	ffstr in, out;
+	ffstr_set2(&in, &packed);
+	for (;;) {
+		int r = ffzipwrite_process(&w, &in, &out);
+		if (r == FFZIPWRITE_DONE)
+			break;
+		switch (r) {
+		case FFZIPWRITE_DATA:
+			ffvec_add2T(&buf, &out, char);  break;
+		case FFZIPWRITE_MORE:
+			ffzipwrite_filefinish(&w);  break;
+		case FFZIPWRITE_FILEDONE:
+			ffzipwrite_finish(&w);  break;
+		default:
+			x(0);
+		}
+	}
+	ffzipwrite_destroy(&w);
+
+	ffzipread r = {};
+	x(0 == ffzipread_open_mapped(&r, buf.ptr, buf.len));
+	ffzipread_fileread(&r, 0, packed.len);
+	ffvec unpacked = {};
+	for (;;) {
+		int rc = ffzipread_process(&r, &in, &out);
+		if (rc == FFZIPREAD_FILEDONE)
+			break;
+		if (rc == FFZIPREAD_DATA)
+			ffvec_add2T(&unpacked, &out, char);
+		else if (rc != FFZIPREAD_FILEHEADER) {
+			fflog("error: %s", ffzipread_error(&r));
+			x(0);
+		}
+	}
+	x(ffvec_eqT(&unpacked, plain.ptr, plain.len, char));
+
+	ffzipread_close(&r);
+	ffvec_free(&unpacked);
+	ffvec_free(&buf);
+	ffvec_free(&packed);
+	ffvec_free(&plain);
+}
+
+/** Write files with automatic selection of compression method (also after raw and known-size entries)
+ and read them back */
+void test_zip_auto()
+{
+	enum { AUTO, RAW, KNOWN };
+	static const struct {
+		const char *name;
+		ffuint expected;
+		ffuint mode;
+	} files[] = {
+		{ "raw", ZIP_DEFLATED, RAW },
+		{ "random", ZIP_STORED, AUTO },
+		{ "known", ZIP_STORED, KNOWN },
+		{ "text", ZIP_DEFLATED, AUTO },
+		{ "empty", ZIP_STORED, AUTO },
+	};
+	ffvec data[FF_COUNT(files)] = {}, packed = {};
+	ffuint rnd = 1;
+	for (ffuint i = 0;  i != 100*1024;  i++) {
+		rnd ^= rnd << 13;  rnd ^= rnd >> 17;  rnd ^= rnd << 5;
+		ffvec_addchar(&data[1], (char)rnd);
+	}
+	for (ffuint i = 0;  data[3].len < 100*1024;  i++) {
+		ffvec_addfmt(&data[3], "line %u: %u\n", i, i * 7919 % 1000);
+	}
+	ffvec_add2T(&data[0], &data[3], char);
+	ffvec_addsz(&data[2], "known data");
+
+	ffvec buf = {};
+	ffzipwrite w = {};
+	ffuint ifile = 0;
+	ffstr in = {}, out;
+	ffsize off = 0;
+	for (;;) {
+		if (ifile != FF_COUNT(files) && w.state == 0 && !w.arc_fin && w.buf.len == 0) {
+			ffzipwrite_conf conf = {};
+			ffstr_setz(&conf.name, files[ifile].name);
+			conf.compress_method = ZIP_DEFLATED;
+			switch (files[ifile].mode) {
+			case AUTO:
+				conf.compress_auto = 1;  break;
+			case RAW:
+				packed.len = 0;
+				x(0 == ffzipwrite_compress(&conf, *(ffstr*)&data[ifile], &packed));
+				break;
+			case KNOWN:
+				conf.compress_method = ZIP_STORED;
+				conf.size_known = 1;
+				conf.crc = crc32(data[ifile].ptr, data[ifile].len, 0);
+				conf.uncompressed_size = data[ifile].len;
+				break;
+			}
+			x(0 == ffzipwrite_fileadd(&w, &conf));
+			off = 0;
+		}
+
+		int r = ffzipwrite_process(&w, &in, &out);
+		switch (r) {
+		case FFZIPWRITE_DATA:
+			ffvec_add2T(&buf, &out, char);  break;
+
+		case FFZIPWRITE_SEEK:
+			buf.len = ffzipwrite_offset(&w);  break;
+
+		case FFZIPWRITE_MORE: {
+			// feed data in 10KB chunks
+			const ffvec *d = (files[ifile].mode == RAW) ? &packed : &data[ifile];
+			if (off == d->len) {
+				ffzipwrite_filefinish(&w);
+				break;
+			}
+			ffstr_set(&in, (char*)d->ptr + off, ffmin(10*1024, d->len - off));
+			off += in.len;
+			break;
+		}
+
+		case FFZIPWRITE_FILEDONE:
+			xieq(files[ifile].expected, ffzipwrite_method(&w));
+			if (files[ifile].mode != RAW)
+				xieq(data[ifile].len, w.file_rd);
+			if (++ifile == FF_COUNT(files))
+				ffzipwrite_finish(&w);
+			break;
+
+		case FFZIPWRITE_DONE:
+			goto done;
+
+		default:
+			x(0);
+		}
+	}
+
+done:
+	ffzipwrite_destroy(&w);
+
+	ffpack_catalog cat = {};
+	ffzipread r = {};
+	x(0 == ffzipread_open_mapped(&r, buf.ptr, buf.len));
+	r.catalog = &cat;
+	xieq(FFZIPREAD_DONE, ffzipread_process(&r, &in, &out));
+	xieq(FF_COUNT(files), cat.len);
+	ffvec unpacked = {};
+	for (ffuint i = 0;  i != cat.len;  i++) {
+		xieq(files[i].expected, ((ffushort*)cat.method.ptr)[i]);
+		ffzipread_fileread(&r, ((ffuint64*)cat.hdr_offset.ptr)[i], ((ffuint64*)cat.comp_size.ptr)[i]);
+		for (;;) {
+			int rc = ffzipread_process(&r, &in, &out);
+			if (rc == FFZIPREAD_FILEDONE)
+				break;
+			if (rc == FFZIPREAD_DATA)
+				ffvec_add2T(&unpacked, &out, char);
+			else if (rc == FFZIPREAD_FILEHEADER)
+				xieq(files[i].expected, ffzipread_fileinfo(&r)->compress_method);
+			else
+				x(0);
+		}
+		x(ffvec_eqT(&unpacked, data[i].ptr, data[i].len, char));
+		unpacked.len = 0;
+	}
+
+	ffzipread_close(&r);
+	ffpack_catalog_free(&cat);
+	ffvec_free(&unpacked);
+	ffvec_free(&buf);
+	ffvec_free(&packed);
+	for (ffuint i = 0;  i != FF_COUNT(files);  i++) {
+		ffvec_free(&data[i]);
+	}
+}
+
+struct test_cache_key {
+	char s[FFZIPWRITE_CACHE_KEY_STR];
+};
+
+struct test_cache {
+	ffvec keys; // struct test_cache_key[]
+	ffvec data; // ffvec[]
+	ffuint gets, puts;
+};
+
+static int test_cache_get(void *opaque, const ffzipwrite_cache_key *key, ffvec *out)
+{
+	struct test_cache *c = (struct test_cache*)opaque;
+	char k[FFZIPWRITE_CACHE_KEY_STR];
+	xieq(FFZIPWRITE_CACHE_KEY_STR, ffzipwrite_cache_key_str(key, k, sizeof(k)));
+	c->gets++;
+	for (ffsize i = 0;  i != c->keys.len;  i++) {
+		if (!ffmem_cmp(ffslice_itemT(&c->keys, i, struct test_cache_key)->s, k, FFZIPWRITE_CACHE_KEY_STR)) {
+			ffvec_add2T(out, ffslice_itemT(&c->data, i, ffvec), char);
+			return 0;
+		}
+	}
+	ffvec_addsz(out, "partial"); // e.g. a read error in the middle of the cached data
+	return -1;
+}
+
+static void test_cache_put(void *opaque, const ffzipwrite_cache_key *key, ffstr data)
+{
+	struct test_cache *c = (struct test_cache*)opaque;
+	ffzipwrite_cache_key_str(key, ffvec_pushT(&c->keys, struct test_cache_key)->s, FFZIPWRITE_CACHE_KEY_STR);
+	ffvec *d = ffvec_pushT(&c->data, ffvec);
+	ffvec_null(d);
+	ffvec_add2T(d, &data, char);
+	c->puts++;
+}
+
+/** SHA-256 test vectors (FIPS 180-4 examples) */
+static void test_sha256()
+{
+	static const struct {
+		const char *data;
+		ffuint repeat;
+		const char *hash;
+	} v[] = {
+		{ "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+		{ "", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1
+			, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+		{ "a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+	};
+	for (ffuint i = 0;  i != FF_COUNT(v);  i++) {
+		ffpack_sha256 s;
+		ffbyte h[32];
+		char hex[64];
+		ffpack_sha256_init(&s);
+		for (ffuint k = 0;  k != v[i].repeat;  k++) {
+			ffpack_sha256_update(&s, v[i].data, ffsz_len(v[i].data));
+		}
+		ffpack_sha256_fin(&s, h);
+		for (ffuint k = 0;  k != 32;  k++) {
+			ffs_format(hex + k * 2, 3, "%02xu", (ffuint)h[k]);
+		}
+		x(!ffmem_cmp(hex, v[i].hash, 64));
+	}
+}
+
+void test_zip_compress_cached()
+{
+	test_sha256();
+
+	struct test_cache c = {};
+	ffzipwrite_cache cache = { test_cache_get, test_cache_put, &c };
+	ffstr data;
+	ffstr_setz(&data, "plain data plain data plain data");
+	ffvec out1 = {}, out2 = {};
+
+	ffzipwrite_conf conf = {};
+	conf.compress_method = ZIP_DEFLATED;
+	xieq(0, ffzipwrite_compress_cached(&cache, &conf, data, &out1));
+	x(conf.raw);
+	xieq(1, c.puts);
+	ffvec ref = {};
+	ffzipwrite_conf conf_ref = {};
+	conf_ref.compress_method = ZIP_DEFLATED;
+	x(0 == ffzipwrite_compress(&conf_ref, data, &ref));
+	x(ffvec_eqT(&out1, ref.ptr, ref.len, char));
+	ffvec_free(&ref);
+
+	ffzipwrite_conf conf2 = {};
+	conf2.compress_method = ZIP_DEFLATED;
+	xieq(1, ffzipwrite_compress_cached(&cache, &conf2, data, &out2));
+	x(ffvec_eqT(&out1, out2.ptr, out2.len, char));
+	xieq(conf.crc, conf2.crc);
+	xieq(conf.uncompressed_size, conf2.uncompressed_size);
+	xieq(conf.compressed_size, conf2.compressed_size);
+
+	// another level: cache miss
+	conf2.deflate_level = 9;
+	out2.len = 0;
+	xieq(0, ffzipwrite_compress_cached(&cache, &conf2, data, &out2));
+	xieq(3, c.gets);
+	xieq(2, c.puts);
+
+	ffvec *d;
+	FFSLICE_WALK(&c.data, d) {
+		ffvec_free(d);
+	}
+	ffvec_free(&c.data);
+	ffvec_free(&c.keys);
+	ffvec_free(&out1);
+	ffvec_free(&out2);
+}
+
+/** Write many files so that CDIR is split into segments */
+void test_zip_cdir_segments(ffuint spill)
+{
+	const ffuint N = 30000;
+	ffvec buf = {}, spilled = {};
+	ffzipwrite w = {};
+	w.cdir_spill = spill;
+	ffuint ifile = 0, nspill = 0;
+	char name[32];
+	ffstr in = {}, out;
+	for (;;) {
+		if (w.state == 0 && !w.arc_fin && w.buf.len == 0) {
+			ffzipwrite_conf conf = {};
+			conf.name.ptr = name;
+			conf.name.len = ffs_format(name, sizeof(name), "file%u", ifile);
+			x(0 == ffzipwrite_fileadd(&w, &conf));
+		}
+
+		int r = ffzipwrite_process(&w, &in, &out);
+		switch (r) {
+		case FFZIPWRITE_DATA:
+			ffvec_add2T(&buf, &out, char);  break;
+
+		case FFZIPWRITE_SEEK:
+			buf.len = ffzipwrite_offset(&w);  break;
+
+		case FFZIPWRITE_MORE:
+			ffzipwrite_filefinish(&w);  break;
+
+		case FFZIPWRITE_FILEDONE:
+			if (++ifile == N - 1) {
+				// the first entry is in the first segment
+				if (spill)
+					xieq(-3, ffzipwrite_cdir_remove(&w, FFSTR_Z("file0")));
+				else
+					xieq(0, ffzipwrite_cdir_remove(&w, FFSTR_Z("file0")));
+			} else if (ifile == N) {
+				ffzipwrite_finish(&w);
+			}
+			break;
+
+		case FFZIPWRITE_CDIR_SPILL:
+			x(spill);
+			ffvec_add2T(&spilled, &out, char);
+			nspill++;
+			break;
+
+		case FFZIPWRITE_CDIR_UNSPILL:
+			ffvec_add2T(&buf, &spilled, char);
+			break;
+
+		case FFZIPWRITE_DONE:
+			goto done;
+
+		default:
+			x(0);
+		}
+	}
+
+done:
+	x(w.cdir_segs.len >= 2);
+	if (spill)
+		xieq(w.cdir_segs.len, nspill);
+	xieq(buf.len, ffzipwrite_offset(&w));
+	ffzipwrite_destroy(&w);
+
+	ffpack_catalog cat = {};
+	ffzipread r = {};
+	x(0 == ffzipread_open_mapped(&r, buf.ptr, buf.len));
+	r.catalog = &cat;
+	xieq(FFZIPREAD_DONE, ffzipread_process(&r, &in, &out));
+	xieq(N - !spill, cat.len);
+	ffstr fn = ffpack_catalog_name(&cat, cat.len - 1);
+	xseq(&fn, "file29999");
+	fn = ffpack_catalog_name(&cat, 0);
+	xseq(&fn, (spill) ? "file0" : "file1");
+	ffzipread_close(&r);
+	ffpack_catalog_free(&cat);
+	ffvec_free(&buf);
+	ffvec_free(&spilled);
+}
+
 void test_zip_read(const ffvec *buf)
 {
 	struct member *m;
@@ -213,6 +782,570 @@ done:
 	ffvec_free(&uncomp);
 }
 
+void test_catalog_save_load(const ffpack_catalog *cat, ffuint64 archive_size)
+{
+	ffpack_catalog_valid v = {
+		.archive_size = archive_size,
+		.archive_mtime = 1234567890,
+		.meta_hash = cat->meta_hash,
+	};
+	ffvec d = {};
+	x(0 == ffpack_catalog_save(cat, &v, &d));
+
+	ffpack_catalog c2 = {};
+	x(0 == ffpack_catalog_load(&c2, d.ptr, d.len, &v));
+	xieq(cat->len, c2.len);
+	for (ffuint i = 0;  i != cat->len;  i++) {
+		ffpack_catalog_ent e, e2;
+		ffpack_catalog_get(cat, i, &e);
+		ffpack_catalog_get(&c2, i, &e2);
+		x(ffstr_eq2(&e.name, &e2.name));
+		xieq(e.hdr_offset, e2.hdr_offset);
+		xieq(e.comp_size, e2.comp_size);
+		xieq(e.size, e2.size);
+		xieq(e.crc, e2.crc);
+		xieq(e.method, e2.method);
+		xieq(e.mtime, e2.mtime);
+		xieq(e.attr, e2.attr);
+		xieq(i, ffpack_catalog_find(&c2, e.name));
+	}
+	xieq(cat->data_end, c2.data_end);
+	x(0 > ffpack_catalog_find(&c2, FFSTR_Z("not-found")));
+	ffpack_catalog_free(&c2); // data isn't owned
+
+	v.archive_mtime++;
+	x(-2 == ffpack_catalog_load(&c2, d.ptr, d.len, &v));
+	v.archive_mtime--;
+	x(-1 == ffpack_catalog_load(&c2, d.ptr, d.len - 1, &v));
+	((char*)d.ptr)[d.len - 1] = 'x';
+	x(-1 == ffpack_catalog_load(&c2, d.ptr, d.len, &v));
+	ffvec_free(&d);
+}
+
+struct zip_worker {
+	ffzipread r;
+	ffstr in;
+	ffvec data;
+	ffuint ifile;
+	ffuint busy;
+};
+
+/** Extract all files with 2 readers sharing one catalog, interleaving their calls */
+void test_zip_read_parallel(const ffvec *buf, const ffzipread *parent, const ffpack_catalog *cat, ffuint stored_ranges)
+{
+	ffuint order[FF_COUNT(members)];
+	ffpack_catalog_order_size(cat, order);
+	for (ffuint i = 1;  i != cat->len;  i++) {
+		x(((ffuint64*)cat->comp_size.ptr)[order[i - 1]] >= ((ffuint64*)cat->comp_size.ptr)[order[i]]);
+	}
+
+	struct zip_worker wk[2] = {};
+	ffuint next = 0, done = 0;
+	while (done != cat->len) {
+		for (ffuint k = 0;  k != 2;  k++) {
+			struct zip_worker *w = &wk[k];
+			if (!w->busy) {
+				if (next == cat->len)
+					continue;
+				w->ifile = order[next++];
+				x(0 == ffzipread_open_file(&w->r, parent, cat, w->ifile));
+				w->r.stored_ranges = stored_ranges;
+				w->busy = 1;
+			}
+
+			ffstr out;
+			int rc = ffzipread_process(&w->r, &w->in, &out);
+			switch (rc) {
+			case FFZIPREAD_SEEK:
+				// positional read
+				ffstr_set(&w->in, (char*)buf->ptr + ffzipread_offset(&w->r), 1);
+				break;
+
+			case FFZIPREAD_MORE:
+				x(w->in.ptr != ffslice_endT(buf, char));
+				w->in.len = 1;
+				break;
+
+			case FFZIPREAD_FILEHEADER: {
+				ffstr name = ffpack_catalog_name(cat, w->ifile);
+				x(ffstr_eq2(&ffzipread_fileinfo(&w->r)->name, &name));
+				break;
+			}
+
+			case FFZIPREAD_DATA:
+				ffvec_add2T(&w->data, &out, char);
+				break;
+
+			case FFZIPREAD_RANGE: {
+				x(stored_ranges);
+				xieq(ZIP_STORED, members[w->ifile].compress_method);
+				const ffzipread_range_t *rng = ffzipread_range(&w->r);
+				x(rng->offset + rng->size <= buf->len);
+				ffvec_add(&w->data, (char*)buf->ptr + rng->offset, rng->size, 1);
+				if (rng->crc != 0)
+					xieq(crc32(w->data.ptr, w->data.len, 0), rng->crc);
+				w->in.len = 0;
+				break;
+			}
+
+			case FFZIPREAD_FILEDONE:
+				if (members[w->ifile].osize != 0)
+					x(ffvec_eqT(&w->data, "plain data", 10, char));
+				else
+					xieq(0, w->data.len);
+				w->data.len = 0;
+				w->busy = 0;
+				done++;
+				break;
+
+			default:
+				fflog("error: %s", ffzipread_error(&w->r));
+				x(0);
+			}
+		}
+	}
+
+	for (ffuint k = 0;  k != 2;  k++) {
+		ffzipread_close(&wk[k].r);
+		ffvec_free(&wk[k].data);
+	}
+}
+
+void test_zip_read_mapped(const ffvec *buf)
+{
+	ffpack_catalog cat = {};
+	ffzipread r = {};
+	x(0 == ffzipread_open_mapped(&r, buf->ptr, buf->len));
+	r.catalog = &cat;
+	ffstr in = {}, out;
+	xieq(FFZIPREAD_DONE, ffzipread_process(&r, &in, &out));
+	xieq(FF_COUNT(members), cat.len);
+
+	ffvec data = {};
+	for (ffuint i = 0;  i != cat.len;  i++) {
+		const struct member *m = &members[i];
+		ffzipread_fileread(&r, ((ffuint64*)cat.hdr_offset.ptr)[i], ((ffuint64*)cat.comp_size.ptr)[i]);
+		for (;;) {
+			int rc = ffzipread_process(&r, &in, &out);
+			if (rc == FFZIPREAD_FILEDONE)
+				break;
+
+			switch (rc) {
+			case FFZIPREAD_FILEHEADER:
+				break;
+
+			case FFZIPREAD_DATA:
+				if (m->compress_method == ZIP_STORED && out.len != 0)
+					x(out.ptr > (char*)buf->ptr && out.ptr < ffslice_endT(buf, char));
+				ffvec_add2T(&data, &out, char);
+				break;
+
+			default:
+				fflog("error: %s", ffzipread_error(&r));
+				x(0);
+			}
+		}
+
+		if (m->osize != 0)
+			x(ffvec_eqT(&data, "plain data", 10, char));
+		else
+			xieq(0, data.len);
+		data.len = 0;
+	}
+
+	ffvec_free(&data);
+	ffzipread_close(&r);
+	ffpack_catalog_free(&cat);
+}
+
+/** Extract the files from the ranges of a read plan */
+void test_zip_read_plan(const ffvec *buf, ffzipread *parent, const ffpack_catalog *cat)
+{
+	ffuint idx[] = { 3, 0, 2 };
+	ffvec plan = {};
+	x(0 == ffzipread_plan(cat, idx, FF_COUNT(idx), 0, &plan));
+	xieq(2, plan.len);
+	xieq(0, idx[0]);
+	xieq(2, idx[1]);
+	xieq(3, idx[2]);
+	plan.len = 0;
+
+	ffuint all[FF_COUNT(members)];
+	for (ffuint i = 0;  i != FF_COUNT(all);  i++) {
+		all[i] = FF_COUNT(all) - 1 - i;
+	}
+	x(0 == ffzipread_plan(cat, all, FF_COUNT(all), 0, &plan));
+	xieq(1, plan.len);
+	const ffzipread_plan_range_t *pr = (ffzipread_plan_range_t*)plan.ptr;
+	xieq(0, pr->offset);
+	ffuint64 cdir_off, cdir_size;
+	ffzipread_cdir(parent, &cdir_off, &cdir_size);
+	xieq(cdir_off, pr->size);
+	xieq(FF_COUNT(all), pr->n);
+
+	ffzipread r = {};
+	x(0 == ffzipread_open_file(&r, parent, cat, all[0]));
+	ffstr in = {}, out;
+	ffvec data = {};
+	ffuint ifile = 0, seeks = 0;
+	for (;;) {
+		int rc = ffzipread_process(&r, &in, &out);
+		switch (rc) {
+		case FFZIPREAD_SEEK:
+			seeks++;
+			in.ptr = (char*)buf->ptr + ffzipread_offset(&r);
+			in.len = 1;
+			break;
+
+		case FFZIPREAD_MORE:
+			x(in.ptr + in.len <= (char*)buf->ptr + pr->offset + pr->size);
+			in.len = 1;
+			break;
+
+		case FFZIPREAD_FILEHEADER:
+			xseq(&ffzipread_fileinfo(&r)->name, members[all[ifile]].name);
+			break;
+
+		case FFZIPREAD_DATA:
+			ffvec_add2T(&data, &out, char);
+			break;
+
+		case FFZIPREAD_FILEDONE:
+			xieq(members[all[ifile]].osize, data.len);
+			data.len = 0;
+			if (++ifile == FF_COUNT(all))
+				goto done;
+			ffzipread_fileread_next(&r, ((ffuint64*)cat->hdr_offset.ptr)[all[ifile]], ((ffuint64*)cat->comp_size.ptr)[all[ifile]]);
+			break;
+
+		default:
+			fflog("error: %s", ffzipread_error(&r));
+			x(0);
+		}
+	}
+
+done:
+	xieq(1, seeks);
+	ffvec_free(&data);
+	ffvec_free(&plan);
+	ffzipread_close(&r);
+}
+
+/** Read the archive sequentially in small chunks
+non_seekable: STORED files have data descriptor: expect an error for the first of them */
+void test_zip_read_stream(const ffvec *buf, ffuint non_seekable)
+{
+	ffzipread r = {};
+	x(0 == ffzipread_open_stream(&r));
+	ffstr in = {}, out;
+	ffsize off = 0;
+	ffvec data = {};
+	ffuint ifile = 0;
+	for (;;) {
+		int rc = ffzipread_process(&r, &in, &out);
+		switch (rc) {
+		case FFZIPREAD_MORE:
+			xieq(0, in.len);
+			x(off != buf->len);
+			ffstr_set(&in, (char*)buf->ptr + off, ffmin(7, buf->len - off));
+			off += in.len;
+			break;
+
+		case FFZIPREAD_FILEHEADER:
+			xseq(&ffzipread_fileinfo(&r)->name, members[ifile].name);
+			break;
+
+		case FFZIPREAD_DATA:
+			ffvec_add2T(&data, &out, char);
+			break;
+
+		case FFZIPREAD_FILEDONE:
+			if (members[ifile].osize != 0)
+				x(ffvec_eqT(&data, "plain data", 10, char));
+			else
+				xieq(0, data.len);
+			xieq(members[ifile].osize, ffzipread_fileinfo(&r)->uncompressed_size);
+			data.len = 0;
+			ifile++;
+			break;
+
+		case FFZIPREAD_DONE:
+			x(!non_seekable);
+			xieq(FF_COUNT(members), ifile);
+			goto done;
+
+		case FFZIPREAD_ERROR:
+			if (non_seekable && members[ifile].compress_method == ZIP_STORED)
+				goto done;
+			// fallthrough
+
+		default:
+			fflog("error: %s", ffzipread_error(&r));
+			x(0);
+		}
+	}
+
+done:
+	ffvec_free(&data);
+	ffzipread_close(&r);
+}
+
+/** Write STORED files with known size and CRC: no seeking and no file trailers,
+ so the archive can be read by a streaming reader */
+void test_zip_write_known(ffuint bad_crc)
+{
+	ffstr plain;
+	ffstr_setz(&plain, "plain data");
+	ffvec buf = {};
+	ffzipwrite w = {};
+	w.non_seekable = 1;
+	ffuint ifile = 0;
+	ffstr in = {}, out;
+	for (;;) {
+		if (w.state == 0 && !w.arc_fin && w.buf.len == 0) {
+			ffzipwrite_conf conf = {};
+			ffstr_setz(&conf.name, members[ifile].name);
+			conf.attr_win = members[ifile].attr_win;
+			conf.attr_unix = members[ifile].attr_unix;
+			conf.compress_method = ZIP_STORED;
+			conf.size_known = 1;
+			if (members[ifile].osize != 0) {
+				conf.crc = crc32(plain.ptr, plain.len, 0) + bad_crc;
+				conf.uncompressed_size = plain.len;
+			}
+			x(0 == ffzipwrite_fileadd(&w, &conf));
+		}
+
+		int r = ffzipwrite_process(&w, &in, &out);
+		switch (r) {
+		case FFZIPWRITE_DATA:
+			ffvec_add2T(&buf, &out, char);  break;
+
+		case FFZIPWRITE_MORE:
+			if (!w.file_fin && members[ifile].osize != 0 && w.file_rd == 0)
+				in = plain;
+			else
+				ffzipwrite_filefinish(&w);
+			break;
+
+		case FFZIPWRITE_FILEDONE:
+			if (++ifile == FF_COUNT(members))
+				ffzipwrite_finish(&w);
+			break;
+
+		case FFZIPWRITE_DONE:
+			x(!bad_crc);
+			goto done;
+
+		case FFZIPWRITE_ERROR:
+			x(bad_crc);
+			goto done;
+
+		default:
+			x(0);
+		}
+	}
+
+done:
+	ffzipwrite_destroy(&w);
+	if (!bad_crc)
+		test_zip_read_stream(&buf, 0);
+	ffvec_free(&buf);
+}
+
+/** Copy all files to a new archive without recompression */
+void test_zip_copy_raw(const ffvec *src, ffvec *dst)
+{
+	struct zip_fileinfo infos[FF_COUNT(members)] = {};
+	ffzipread r = {};
+	x(0 == ffzipread_open_mapped(&r, src->ptr, src->len));
+	r.raw = 1;
+	ffstr in = {}, out, data;
+	ffuint n = 0;
+	int rc;
+	while (FFZIPREAD_FILEINFO == (rc = ffzipread_process(&r, &in, &out))) {
+		infos[n] = *ffzipread_fileinfo(&r);
+		ffstr_dupstr(&infos[n].name, &ffzipread_fileinfo(&r)->name);
+		n++;
+	}
+	xieq(FFZIPREAD_DONE, rc);
+	xieq(FF_COUNT(members), n);
+
+	ffzipwrite w = {};
+	for (ffuint i = 0;  i != n;  i++) {
+		ffzipwrite_conf conf = {};
+		ffzipwrite_conf_raw(&conf, &infos[i]);
+		x(0 == ffzipwrite_fileadd(&w, &conf));
+		ffzipread_fileread(&r, infos[i].hdr_offset, infos[i].compressed_size);
+
+		ffstr_null(&data);
+		for (;;) {
+			int wr = ffzipwrite_process(&w, &data, &out);
+			if (wr == FFZIPWRITE_DATA) {
+				ffvec_add2T(dst, &out, char);
+				continue;
+			} else if (wr == FFZIPWRITE_FILEDONE) {
+				break;
+			}
+			xieq(FFZIPWRITE_MORE, wr);
+
+			// pass the next chunk of compressed data to the writer
+			for (;;) {
+				rc = ffzipread_process(&r, &in, &data);
+				if (rc == FFZIPREAD_DATA)
+					break;
+				if (rc == FFZIPREAD_FILEDONE) {
+					ffzipwrite_filefinish(&w);
+					break;
+				}
+				xieq(FFZIPREAD_FILEHEADER, rc);
+			}
+		}
+		ffstr_free(&infos[i].name);
+	}
+
+	ffzipwrite_finish(&w);
+	xieq(FFZIPWRITE_DATA, ffzipwrite_process(&w, &data, &out));
+	ffvec_add2T(dst, &out, char);
+	xieq(FFZIPWRITE_DONE, ffzipwrite_process(&w, &data, &out));
+	ffzipwrite_destroy(&w);
+	ffzipread_close(&r);
+}
+
+/** Replace the last file in archive */
+void test_zip_append(ffvec *buf)
+{
+	ffzipread r = {};
+	x(0 == ffzipread_open_mapped(&r, buf->ptr, buf->len));
+	ffstr in = {}, out;
+	int rc;
+	while (FFZIPREAD_FILEINFO == (rc = ffzipread_process(&r, &in, &out))) {
+	}
+	xieq(FFZIPREAD_DONE, rc);
+	ffuint64 cdir_off, cdir_size;
+	ffzipread_cdir(&r, &cdir_off, &cdir_size);
+	ffzipread_close(&r);
+
+	ffstr cdir;
+	ffstr_set(&cdir, (char*)buf->ptr + cdir_off, cdir_size);
+	ffzipwrite w = {};
+	x(0 == ffzipwrite_open_append(&w, cdir, cdir_off));
+	const struct member *m = &members[FF_COUNT(members) - 1];
+	x(0 > ffzipwrite_cdir_remove(&w, FFSTR_Z("not-found")));
+	ffstr name;
+	ffstr_setz(&name, m->name);
+	x(0 == ffzipwrite_cdir_remove(&w, name));
+
+	ffzipwrite_conf conf = {};
+	ffstr_setz(&conf.name, m->name);
+	conf.mtime.sec = m->mtime;
+	conf.attr_win = m->attr_win;
+	conf.attr_unix = m->attr_unix;
+	conf.uid = m->uid;
+	conf.gid = m->gid;
+	x(0 == ffzipwrite_fileadd(&w, &conf));
+	xieq(-2, ffzipwrite_cdir_remove(&w, name)); // the file is being written
+
+	ffuint64 off = 0;
+	ffuint seeks = 0;
+	for (;;) {
+		int r = ffzipwrite_process(&w, &in, &out);
+		switch (r) {
+		case FFZIPWRITE_SEEK:
+			if (seeks++ == 0)
+				xieq(cdir_off, ffzipwrite_offset(&w));
+			off = ffzipwrite_offset(&w);
+			break;
+
+		case FFZIPWRITE_DATA:
+			x(off <= buf->len);
+			buf->len = ffmax(buf->len, off + out.len);
+			ffvec_grow(buf, out.len, 1);
+			ffmem_copy((char*)buf->ptr + off, out.ptr, out.len);
+			off += out.len;
+			break;
+
+		case FFZIPWRITE_MORE:
+			ffzipwrite_filefinish(&w);  break;
+
+		case FFZIPWRITE_FILEDONE:
+			ffzipwrite_finish(&w);  break;
+
+		case FFZIPWRITE_DONE:
+			buf->len = ffzipwrite_offset(&w); // truncate
+			ffzipwrite_destroy(&w);
+			return;
+
+		default:
+			x(0);
+		}
+	}
+}
+
+void test_zip_read_catalog(const ffvec *buf)
+{
+	ffpack_catalog cat = {};
+	ffzipread r = {};
+	x(0 == ffzipread_open(&r, buf->len));
+	r.catalog = &cat;
+	ffstr in, out;
+	ffstr_set(&in, buf->ptr, 0);
+
+	for (;;) {
+		int rc = ffzipread_process(&r, &in, &out);
+
+		switch (rc) {
+		case FFZIPREAD_MORE:
+			x(0);
+			break;
+
+		case FFZIPREAD_SEEK:
+			x(ffzipread_offset(&r) < buf->len);
+			ffstr_set(&in, (char*)buf->ptr + ffzipread_offset(&r), buf->len - ffzipread_offset(&r));
+			break;
+
+		case FFZIPREAD_DONE:
+			goto done;
+
+		default:
+			fflog("error: %s", ffzipread_error(&r));
+			x(0);
+		}
+	}
+
+done:
+	xieq(FF_COUNT(members), cat.len);
+	for (ffuint i = 0;  i != cat.len;  i++) {
+		const struct member *m = &members[i];
+		ffpack_catalog_ent e;
+		ffpack_catalog_get(&cat, i, &e);
+		xseq(&e.name, m->name);
+		xieq(m->mtime, e.mtime);
+		xieq(m->compress_method, e.method);
+		xieq(m->osize, e.size);
+		xieq(m->offset, e.hdr_offset);
+		xieq(m->compsize, e.comp_size);
+		xieq(m->attr_unix, e.attr >> 16);
+	}
+
+	test_catalog_save_load(&cat, buf->len);
+	test_zip_read_parallel(buf, &r, &cat, 0);
+	test_zip_read_parallel(buf, &r, &cat, 1);
+	test_zip_read_plan(buf, &r, &cat);
+
+	// plan from a loaded catalog
+	ffpack_catalog_valid v = { .archive_size = buf->len };
+	ffvec d = {};
+	ffpack_catalog c2 = {};
+	x(0 == ffpack_catalog_save(&cat, &v, &d));
+	x(0 == ffpack_catalog_load(&c2, d.ptr, d.len, &v));
+	test_zip_read_plan(buf, &r, &c2);
+	ffvec_free(&d);
+
+	ffzipread_close(&r);
+	ffpack_catalog_free(&cat);
+}
+
 void test_zip()
 {
 	ffvec buf = {};
@@ -220,10 +1353,50 @@ void test_zip()
 
 	test_zip_write(&buf, 0);
 	test_zip_read(&buf);
+	test_zip_read_catalog(&buf);
+	test_zip_read_mapped(&buf);
+	test_zip_read_stream(&buf, 0);
+
+	ffvec copy = {};
+	test_zip_copy_raw(&buf, &copy);
+	test_zip_read(&copy);
+	test_zip_read_stream(&copy, 0);
+	ffvec_free(&copy);
+
+	test_zip_append(&buf);
+	test_zip_read(&buf);
 	buf.len = 0;
 
 	test_zip_write(&buf, 1);
 	test_zip_read(&buf);
+	test_zip_read_catalog(&buf);
+	test_zip_read_mapped(&buf);
+	test_zip_read_stream(&buf, 1);
+	buf.len = 0;
+
+	test_zip_parts(ZIP_DEFLATED);
+	test_zip_parts(ZIP_ZSTANDARD);
+	test_zip_auto();
+	test_zip_compress_cached();
+	test_zip_write_known(0);
+	test_zip_write_known(1);
+	test_zip_cdir_segments(0);
+	test_zip_cdir_segments(1);
+
+	test_zip_write_raw(&buf, 1);
+	test_zip_read(&buf);
+	test_zip_read_catalog(&buf);
+	test_zip_read_stream(&buf, 0);
+	buf.len = 0;
+
+	test_zip_write_mixed(&buf, 0);
+	test_zip_read(&buf);
+	test_zip_read_stream(&buf, 0);
+	buf.len = 0;
+
+	test_zip_write_mixed(&buf, 1);
+	test_zip_read(&buf);
+	test_zip_read_stream(&buf, 0);
 	buf.len = 0;
 
 	ffvec_free(&buf);
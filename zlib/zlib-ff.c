@@ -77,6 +77,11 @@ void z_deflate_reset(z_ctx *z)
 	deflateReset(&z->stm);
 }
 
+int z_deflate_dict(z_ctx *z, const char *dict, size_t len)
+{
+	return deflateSetDictionary(&z->stm, (void*)dict, len);
+}
+
 int z_deflate(z_ctx *z, const char *data, size_t *len, char *dst, size_t cap, unsigned int flags)
 {
 	z->stm.next_in = (void*)data;
@@ -66,6 +66,11 @@ Return the number of bytes written;
 	enum Z_ERR on error */
 EXP int z_deflate(z_ctx *z, const char *data, size_t *len, char *dst, size_t cap, unsigned int flags);
 
+/** Set preset dictionary: the data preceding the input.
+Must be called before the first z_deflate().
+Return 0 on success. */
+EXP int z_deflate_dict(z_ctx *z, const char *dict, size_t len);
+
 
 /**
 Return 0 on success. */